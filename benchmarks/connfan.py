@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+"""Connection fan-out load generator used by scale_conns.sh.
+
+  connfan.py serve   --addr A --ports P [--workers W]
+  connfan.py connect --addr A --ports P --conns N [--active PCT]
+                     [--duration S] [--cc CC] [--ready FILE]
+
+The server sinks everything it receives.  The client opens N connections
+spread over P destination ports (one port carries at most ~64k flows per
+source address), touches FILE once all of them are established, then keeps
+PCT percent of them busy with bulk data and sends a small heartbeat on
+every idle one each --idle-interval seconds, for S seconds.
+"""
+
+import argparse
+import multiprocessing as mp
+import os
+import resource
+import selectors
+import socket
+import sys
+import time
+
+CHUNK = b"\0" * 65536
+HEARTBEAT = b"\0" * 64
+
+
+def raise_nofile(n):
+    want = n + 1024
+    soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    if soft < want:
+        resource.setrlimit(resource.RLIMIT_NOFILE, (want, max(hard, want)))
+
+
+def serve_worker(addr, ports, maxconns):
+    raise_nofile(maxconns)
+    sel = selectors.DefaultSelector()
+    for port in ports:
+        ls = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        ls.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        ls.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEPORT, 1)
+        ls.bind((addr, port))
+        ls.listen(65535)
+        ls.setblocking(False)
+        sel.register(ls, selectors.EVENT_READ, None)
+    while True:
+        for key, _ in sel.select():
+            if key.data is None:
+                try:
+                    while True:
+                        c, _ = key.fileobj.accept()
+                        c.setblocking(False)
+                        sel.register(c, selectors.EVENT_READ, 1)
+                except (BlockingIOError, OSError):
+                    pass
+                continue
+            try:
+                if not key.fileobj.recv(1 << 20):
+                    raise ConnectionError
+            except BlockingIOError:
+                pass
+            except OSError:
+                sel.unregister(key.fileobj)
+                key.fileobj.close()
+
+
+def connect_all(addr, ports, n, cc):
+    socks, pending = [], {}
+    sel = selectors.DefaultSelector()
+    i = 0
+    while i < n or pending:
+        while i < n and len(pending) < 1024:
+            s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+            if cc:
+                s.setsockopt(socket.IPPROTO_TCP, socket.TCP_CONGESTION, cc.encode())
+            s.setblocking(False)
+            s.connect_ex((addr, ports[i % len(ports)]))
+            pending[s.fileno()] = s
+            sel.register(s, selectors.EVENT_WRITE)
+            i += 1
+        for key, _ in sel.select(timeout=5):
+            s = key.fileobj
+            sel.unregister(s)
+            del pending[s.fileno()]
+            if s.getsockopt(socket.SOL_SOCKET, socket.SO_ERROR):
+                s.close()
+                continue
+            socks.append(s)
+    sel.close()
+    return socks
+
+
+def connect_worker(args, ports, n, ready_q, go_ev):
+    raise_nofile(n)
+    socks = connect_all(args.addr, ports, n, args.cc)
+    ready_q.put(len(socks))
+    go_ev.wait()
+
+    nactive = len(socks) * args.active // 100
+    active, idle = socks[:nactive], socks[nactive:]
+    sel = selectors.DefaultSelector()
+    for s in active:
+        sel.register(s, selectors.EVENT_WRITE)
+
+    end = time.monotonic() + args.duration
+    # Idle heartbeats are spread evenly over the interval instead of bursting.
+    tick = 0.1
+    per_tick = max(1, int(len(idle) * tick / args.idle_interval)) if idle else 0
+    next_tick, pos = time.monotonic(), 0
+    while time.monotonic() < end:
+        for key, _ in sel.select(timeout=tick):
+            try:
+                key.fileobj.send(CHUNK)
+            except BlockingIOError:
+                pass
+            except OSError:
+                sel.unregister(key.fileobj)
+        now = time.monotonic()
+        if idle and now >= next_tick:
+            next_tick = now + tick
+            for _ in range(per_tick):
+                try:
+                    idle[pos].send(HEARTBEAT)
+                except OSError:
+                    pass
+                pos = (pos + 1) % len(idle)
+    for s in socks:
+        s.close()
+
+
+def split(n, parts):
+    return [n // parts + (1 if k < n % parts else 0) for k in range(parts)]
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument("mode", choices=("serve", "connect"))
+    p.add_argument("--addr", required=True)
+    p.add_argument("--ports", type=int, default=1,
+                   help="number of destination ports starting at --base-port")
+    p.add_argument("--base-port", type=int, default=20000)
+    p.add_argument("--workers", type=int, default=os.cpu_count())
+    p.add_argument("--conns", type=int, default=10000)
+    p.add_argument("--active", type=int, default=1, help="percent of busy flows")
+    p.add_argument("--idle-interval", type=float, default=10.0)
+    p.add_argument("--duration", type=float, default=30.0)
+    p.add_argument("--cc", default=None)
+    p.add_argument("--ready", default=None)
+    args = p.parse_args()
+    ports = list(range(args.base_port, args.base_port + args.ports))
+
+    if args.mode == "serve":
+        per = args.conns // args.workers + 1
+        procs = [mp.Process(target=serve_worker, args=(args.addr, ports, per))
+                 for _ in range(args.workers)]
+        for pr in procs:
+            pr.start()
+        for pr in procs:
+            pr.join()
+        return
+
+    ready_q, go_ev = mp.Queue(), mp.Event()
+    procs = [mp.Process(target=connect_worker, args=(args, ports, n, ready_q, go_ev))
+             for n in split(args.conns, args.workers) if n]
+    for pr in procs:
+        pr.start()
+    established = sum(ready_q.get() for _ in procs)
+    print(f"established {established}/{args.conns}", file=sys.stderr)
+    if args.ready:
+        with open(args.ready, "w") as f:
+            f.write(f"{established}\n")
+    go_ev.set()
+    for pr in procs:
+        pr.join()
+
+
+if __name__ == "__main__":
+    main()
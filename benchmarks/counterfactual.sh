@@ -0,0 +1,176 @@
+#!/usr/bin/env bash
+# Counterfactual: what one of Spline's decisions costs, by forking a flow at
+# a chosen ACK and replaying the next K RTTs with the decision changed.
+#
+# usage: counterfactual.sh [-a ALTERNATIVES] [-n REPS] [-T SECONDS] [-m MODE]
+#                          [-K RTTS] [-r MBIT] [-R RTT_MS] [-b BDP_MULT]
+#                          [-x CROSS] [-o OUTDIR]
+#
+#   -a  decisions to try, each against the unchanged run ("none"):
+#         branch-loss branch-unfair branch-max branch-drain
+#                      force that next_cwnd branch (spline_next_cwnd_hook)
+#         epoch-N      force EPOCH_ROUND = N (spline_epoch_round_hook)
+#         no-backoff   skip loss_backoff_cwnd (spline_backoff_hook)
+#   -n  repetitions of every alternative
+#   -T  fork point: the first ACK of the flow after T seconds ...
+#   -m  ... that is in this mode (0 START, 1 PROBE_BW, 2 PROBE_RTT, 3 DRAIN,
+#       "any" by default)
+#   -K  length of the forked part in min RTTs at the fork point
+#   -x  cross traffic: 0, an unresponsive UDP rate in Mbit/s or "tcp" (CUBIC)
+#
+# A kernel flow cannot be copied, so a fork is a fresh flow on a fresh
+# topology driven to the same fork point; alternatives of one repetition run
+# back to back and are compared in pairs. At the fork bpftrace stores struct
+# scc, then overrides the chosen hook for K RTTs and measures goodput, mean
+# and max srtt, losses and how often each decision point was reached.
+# counterfactual_report.py turns OUTDIR/counterfactual.csv into report.md.
+# Needs BTF for the module and CONFIG_BPF_KPROBE_OVERRIDE.
+
+set -u
+. "$(dirname "$0")/lib.sh"
+
+ALTS="branch-loss branch-unfair branch-max branch-drain epoch-1 epoch-31 no-backoff"
+REPS=10
+TRIGGER=10
+MODE=any
+K=20
+RATE=50
+RTT=40
+MULT=2
+CROSS=0
+OUT=${OUT:-$BENCH_DIR/results/counterfactual-$(date +%Y%m%d-%H%M%S)}
+
+while getopts "a:n:T:m:K:r:R:b:x:o:h" o; do
+    case $o in
+    a) ALTS=$OPTARG ;;
+    n) REPS=$OPTARG ;;
+    T) TRIGGER=$OPTARG ;;
+    m) MODE=$OPTARG ;;
+    K) K=$OPTARG ;;
+    r) RATE=$OPTARG ;;
+    R) RTT=$OPTARG ;;
+    b) MULT=$OPTARG ;;
+    x) CROSS=$OPTARG ;;
+    o) OUT=$OPTARG ;;
+    *) sed -n '2,28p' "$0"; exit 1 ;;
+    esac
+done
+
+require_root
+require ip tc iperf3 bpftrace python3
+cc_available spline
+mkdir -p "$OUT"
+trap ns_cleanup EXIT
+
+CSV=$OUT/counterfactual.csv
+[ -s "$CSV" ] || echo "alt,rep,mode,snd_cwnd,curr_cwnd,bw,min_rtt_us,curr_rtt_us,loss_cnt,unfair_flag,stable_flag,epoch_round,window_ns,delivered,mss,srtt_mean_us,srtt_max_us,lost,hits_cwnd,hits_epoch,hits_backoff" > "$CSV"
+
+# override <alt>: the bpftrace probe that changes the decision, if any
+override() {
+    local c='((struct spline_cwnd_ctx *)arg1)'
+    case $1 in
+    none) ;;
+    branch-loss)   echo "kprobe:spline_next_cwnd_hook /@sk == arg0 && nsecs < @end/ { override($c->curr_cwnd); }" ;;
+    branch-unfair) echo "kprobe:spline_next_cwnd_hook /@sk == arg0 && nsecs < @end/ { override((($c->target_cwnd + $c->curr_cwnd) * 7) >> 4); }" ;;
+    branch-max)    echo "kprobe:spline_next_cwnd_hook /@sk == arg0 && nsecs < @end/ { override($c->target_cwnd > $c->curr_cwnd ? $c->target_cwnd : $c->curr_cwnd); }" ;;
+    branch-drain)  echo "kprobe:spline_next_cwnd_hook /@sk == arg0 && nsecs < @end/ { override($c->target_cwnd < $c->curr_cwnd ? $c->target_cwnd : $c->curr_cwnd); }" ;;
+    epoch-*)       echo "kprobe:spline_epoch_round_hook /@sk == arg0 && nsecs < @end/ { override(${1#epoch-}); }" ;;
+    no-backoff)    echo "kprobe:spline_backoff_hook /@sk == arg0 && nsecs < @end/ { override(arg1); }" ;;
+    *) die "unknown alternative '$1'" ;;
+    esac
+}
+
+for alt in $ALTS; do
+    override "$alt" > /dev/null
+done
+
+run_one() {
+    local alt=$1 rep=$2 buf secs res mode=$MODE
+    [ "$mode" = any ] && mode=255
+    buf=$(awk -v m="$MULT" -v b="$(bdp_bytes "$RATE" "$RTT")" 'BEGIN {printf "%d", m * b}')
+    secs=$((TRIGGER + 30))
+
+    ns_cleanup
+    topo_dumbbell "$RTT"
+    bottleneck rtr v-wan "${RATE}mbit" bfifo limit "$buf"
+    cc_select cli spline
+    nsx srv iperf3 -s -p 5201 -D
+    nsx srv iperf3 -s -p 5202 -D
+    sleep 1
+
+    # The fork point is the first ACK past TRIGGER of a socket that has
+    # delivered real data, which skips iperf3's control connection.
+    bpftrace --unsafe -q -e '
+BEGIN { @start = nsecs; }
+kprobe:spline_main
+/@sk == 0 && nsecs - @start >= (uint64)$1 * 1000000000 &&
+ ((struct tcp_sock *)arg0)->delivered > 1000 &&
+ ($3 > 3 || ((struct scc *)(arg0 + offsetof(struct inet_connection_sock, icsk_ca_priv)))->current_mode == $3)/
+{
+    $tp = (struct tcp_sock *)arg0;
+    $scc = (struct scc *)(arg0 + offsetof(struct inet_connection_sock, icsk_ca_priv));
+    @sk = arg0;
+    @t0 = nsecs;
+    @end = nsecs + (uint64)$2 * $scc->last_min_rtt * 1000;
+    @d0 = $tp->delivered;
+    @l0 = $tp->lost;
+    printf("snap,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u\n", $scc->current_mode,
+        $tp->snd_cwnd, $scc->curr_cwnd, $scc->bw, $scc->last_min_rtt,
+        $scc->curr_rtt, $scc->loss_cnt, $scc->unfair_flag, $scc->stable_flag,
+        $scc->EPOCH_ROUND);
+}
+kprobe:spline_next_cwnd_hook /@sk == arg0 && nsecs < @end/ { @hc = @hc + 1; }
+kprobe:spline_epoch_round_hook /@sk == arg0 && nsecs < @end/ { @he = @he + 1; }
+kprobe:spline_backoff_hook /@sk == arg0 && nsecs < @end/ { @hb = @hb + 1; }
+'"$(override "$alt")"'
+kprobe:spline_main /@sk == arg0 && nsecs < @end/
+{
+    $s = (uint64)(((struct tcp_sock *)arg0)->srtt_us >> 3);
+    @ssum = @ssum + $s;
+    @sn = @sn + 1;
+    if ($s > @smax) { @smax = $s; }
+}
+kprobe:spline_main /@sk == arg0 && nsecs >= @end/
+{
+    $tp = (struct tcp_sock *)arg0;
+    printf("res,%llu,%u,%u,%llu,%llu,%u,%llu,%llu,%llu\n", nsecs - @t0,
+        $tp->delivered - @d0, $tp->mss_cache, @sn ? @ssum / @sn : 0, @smax,
+        $tp->lost - @l0, @hc, @he, @hb);
+    exit();
+}
+interval:s:'"$secs"' { exit(); }
+END { clear(@start); clear(@sk); clear(@t0); clear(@end); clear(@d0); clear(@l0);
+      clear(@hc); clear(@he); clear(@hb); clear(@ssum); clear(@sn); clear(@smax); }' \
+        "$TRIGGER" "$K" "$mode" > "$OUT/$alt-$rep.bt" 2>"$OUT/$alt-$rep.err" &
+    local bt=$!
+    sleep 2
+
+    case $CROSS in
+    0) ;;
+    tcp) nsx cli iperf3 -c "$SRV_IP" -p 5202 -C cubic -t "$secs" > /dev/null & ;;
+    *)   nsx cli iperf3 -c "$SRV_IP" -p 5202 -u -b "${CROSS}M" -t "$secs" > /dev/null & ;;
+    esac
+    nsx cli iperf3 -c "$SRV_IP" -p 5201 -t "$secs" > /dev/null &
+    wait "$bt"
+    pkill -f "iperf3 -c $SRV_IP" 2>/dev/null
+
+    res=$(awk -F, '/^snap,/ {s = substr($0, 6)} /^res,/ {r = substr($0, 5)}
+        END {if (s != "" && r != "") print s "," r}' "$OUT/$alt-$rep.bt")
+    if [ -z "$res" ]; then
+        log "$alt #$rep: no fork point reached (see $OUT/$alt-$rep.err)"
+        return
+    fi
+    echo "$alt,$rep,$res" >> "$CSV"
+}
+
+log "counterfactual: ${RATE}Mbit/s ${RTT}ms, fork at ${TRIGGER}s for ${K} RTTs, cross $CROSS"
+for rep in $(seq 1 "$REPS"); do
+    for alt in none $ALTS; do
+        log "rep $rep: $alt"
+        run_one "$alt" "$rep"
+    done
+done
+
+python3 "$BENCH_DIR/counterfactual_report.py" "$CSV" > "$OUT/report.md"
+cat "$OUT/report.md"
+log "report in $OUT/report.md"
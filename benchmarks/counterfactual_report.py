@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+"""Compare forked Spline runs against the unchanged run of the same repetition.
+
+  counterfactual_report.py counterfactual.csv
+
+Each row of the CSV is one fork: the struct scc snapshot at the fork point
+(mode, snd_cwnd, curr_cwnd, bw, min_rtt_us, curr_rtt_us, loss_cnt,
+unfair_flag, stable_flag, epoch_round) and what followed over the next K min
+RTTs (window_ns, delivered, mss, srtt_mean_us, srtt_max_us, lost and the
+number of times each decision hook was reached).
+
+For every alternative the report (markdown on stdout) gives the change
+against "none" of the same repetition, as a mean with a 95% interval over
+repetitions:
+  goodput   relative change in goodput over the window, in percent
+  srtt      change in mean and max srtt, in ms
+  lost      change in lost packets
+  reached   how often the changed decision was taken in the window
+  fork gap  how far the two forks were apart at the fork point (snd_cwnd,
+            percent); a large gap means the pair did not share a state and the
+            difference is not only the decision's
+"""
+
+import csv
+import statistics
+import sys
+
+# two-sided 95% Student t for n - 1 degrees of freedom
+T95 = {1: 12.71, 2: 4.30, 3: 3.18, 4: 2.78, 5: 2.57, 6: 2.45, 7: 2.36, 8: 2.31,
+       9: 2.26, 10: 2.23, 15: 2.13, 20: 2.09, 30: 2.04}
+
+HOOK = {"branch": "hits_cwnd", "epoch": "hits_epoch", "no": "hits_backoff"}
+
+
+def t95(dof):
+    k = max(d for d in T95 if d <= dof)
+    return T95[k] if dof < 60 else 1.96
+
+
+def ci(xs):
+    if not xs:
+        return "-"
+    m = statistics.fmean(xs)
+    if len(xs) < 2:
+        return f"{m:+.2f}"
+    h = t95(len(xs) - 1) * statistics.stdev(xs) / len(xs) ** 0.5
+    return f"{m:+.2f} +- {h:.2f}"
+
+
+def goodput(r):
+    ns = int(r["window_ns"])
+    return int(r["delivered"]) * int(r["mss"]) * 8 / ns * 1e3 if ns else 0.0
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit(__doc__)
+    with open(sys.argv[1]) as f:
+        rows = list(csv.DictReader(f))
+    base = {r["rep"]: r for r in rows if r["alt"] == "none"}
+    if not base:
+        sys.exit("no baseline runs")
+
+    alts = []
+    for r in rows:
+        if r["alt"] != "none" and r["alt"] not in alts:
+            alts.append(r["alt"])
+
+    g = [goodput(r) for r in base.values()]
+    s = [int(r["srtt_mean_us"]) / 1e3 for r in base.values()]
+    print(f"# Counterfactual report ({len(base)} repetitions)\n")
+    print(f"Baseline: goodput {statistics.fmean(g):.2f} Mbit/s, "
+          f"mean srtt {statistics.fmean(s):.1f} ms over the window.\n")
+    print("| alternative | pairs | goodput % | mean srtt ms | max srtt ms | lost | reached | fork gap % |")
+    print("|-------------|-------|-----------|--------------|-------------|------|---------|------------|")
+    for alt in alts:
+        dg, ds, dm, dl, hits, gap = [], [], [], [], [], []
+        for r in rows:
+            b = base.get(r["rep"])
+            if r["alt"] != alt or b is None:
+                continue
+            gb = goodput(b)
+            if gb:
+                dg.append(100 * (goodput(r) - gb) / gb)
+            ds.append((int(r["srtt_mean_us"]) - int(b["srtt_mean_us"])) / 1e3)
+            dm.append((int(r["srtt_max_us"]) - int(b["srtt_max_us"])) / 1e3)
+            dl.append(int(r["lost"]) - int(b["lost"]))
+            hits.append(int(r[HOOK[alt.split("-")[0]]]))
+            cb = int(b["snd_cwnd"])
+            if cb:
+                gap.append(100 * abs(int(r["snd_cwnd"]) - cb) / cb)
+        print(f"| `{alt}` | {len(ds)} | {ci(dg)} | {ci(ds)} | {ci(dm)} | {ci(dl)} | "
+              f"{statistics.fmean(hits) if hits else 0:.0f} | "
+              f"{statistics.median(gap) if gap else 0:.0f} |")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,165 @@
+#!/usr/bin/env bash
+# Estimator accuracy: Spline's internal estimates versus the known truth of
+# an emulated path.
+#
+# usage: estimator_accuracy.sh [-s "step rtt-step cross-udp cross-tcp policer"]
+#                              [-o OUTDIR]
+#
+# The bottleneck rate, the base RTT, unresponsive cross traffic and a policer
+# are changed on a fixed schedule; every change is stamped with
+# CLOCK_MONOTONIC so it lines up with the bpftrace samples of struct scc
+# (scc->bw and its variance, bandwidth(), lt_bw, last_min_rtt, curr_rtt,
+# xt_share) taken every 10 ms inside spline_main. The bottleneck backlog is
+# sampled as well, which gives the true queueing delay behind curr_rtt.
+# estimator_report.py turns that into bias / variance / lag per estimator and
+# scenario.
+#
+# Needs a module built with BTF (CONFIG_DEBUG_INFO_BTF_MODULES) so that
+# bpftrace knows struct scc.
+
+set -u
+. "$(dirname "$0")/lib.sh"
+
+SCENARIOS="step rtt-step cross-udp cross-tcp policer"
+OUT=${OUT:-$BENCH_DIR/results/estimators-$(date +%Y%m%d-%H%M%S)}
+
+while getopts "s:o:h" o; do
+    case $o in
+    s) SCENARIOS=$OPTARG ;;
+    o) OUT=$OPTARG ;;
+    *) sed -n '2,18p' "$0"; exit 1 ;;
+    esac
+done
+
+require_root
+require ip tc iperf3 bpftrace python3
+cc_available spline
+mkdir -p "$OUT"
+trap ns_cleanup EXIT
+
+# Segments: "seconds capacity_mbit base_rtt_ms cross police_mbit", where
+# cross is an unresponsive UDP rate in Mbit/s or "tcp" for one CUBIC flow.
+declare -A SCHEDULE=(
+    [step]="20 50 40 0 0;20 100 40 0 0;20 20 40 0 0"
+    [rtt-step]="20 50 20 0 0;20 50 80 0 0;20 50 20 0 0"
+    [cross-udp]="20 100 40 0 0;20 100 40 50 0;20 100 40 0 0"
+    [cross-tcp]="20 100 40 0 0;40 100 40 tcp 0"
+    [policer]="30 100 40 0 10;30 100 40 0 0"
+)
+
+mono_ns() { python3 -c 'import time; print(time.monotonic_ns())'; }
+
+set_rtt() {
+    local half
+    half=$(awk -v r="$1" 'BEGIN {printf "%.3fms", r / 2}')
+    nsx wan tc qdisc change dev v-rtr root netem delay "$half" limit 1000000
+    nsx wan tc qdisc change dev v-srv root netem delay "$half" limit 1000000
+}
+
+set_police() {
+    nsx rtr tc qdisc del dev v-cli ingress 2>/dev/null
+    [ "$1" = 0 ] && return
+    nsx rtr tc qdisc add dev v-cli ingress
+    nsx rtr tc filter add dev v-cli parent ffff: protocol ip matchall \
+        action police rate "${1}mbit" burst 64k drop
+}
+
+# apply <tag> <seconds> <cap> <rtt> <cross> <police>
+apply() {
+    local tag=$1 secs=$2 cap=$3 rtt=$4 cross=$5 police=$6
+    nsx rtr tc class change dev v-wan parent 1: classid 1:1 htb rate "${cap}mbit" ceil "${cap}mbit"
+    set_rtt "$rtt"
+    set_police "$police"
+    case $cross in
+    0) ;;
+    tcp)
+        nsx cli iperf3 -c "$SRV_IP" -p 5202 -C cubic -t "$secs" -i 0.5 -J \
+            > "$OUT/$tag.cross.json" &
+        echo "$(mono_ns)" > "$OUT/$tag.cross.start"
+        cross=0 ;;
+    *)
+        nsx cli iperf3 -c "$SRV_IP" -p 5202 -u -b "${cross}M" -t "$secs" > /dev/null & ;;
+    esac
+    echo "$(mono_ns),$cap,$rtt,$cross,$police" >> "$OUT/$tag.truth.csv"
+}
+
+sample_backlog() {
+    while :; do
+        echo "$(mono_ns),$(nsx rtr tc -s qdisc show dev v-wan | awk '
+            /^qdisc/ { leaf = ($3 == "10:") }
+            leaf && /backlog/ {
+                v = $2; m = 1
+                if (v ~ /Kb$/) m = 1024; else if (v ~ /Mb$/) m = 1048576
+                sub(/[KM]?b$/, "", v); print v * m; exit
+            }')"
+        sleep 0.1
+    done
+}
+
+cross_series() {
+    python3 -c 'import json, sys
+start = int(open(sys.argv[2]).read())
+for iv in json.load(open(sys.argv[1]))["intervals"]:
+    s = iv["sum"]
+    print("%d,%.3f" % (start + int(s["end"] * 1e9), s["bits_per_second"] / 1e6))' "$1" "$2"
+}
+
+run_one() {
+    local tag=$1 segs total=0 seg
+    IFS=';' read -ra segs <<< "${SCHEDULE[$tag]}"
+    for seg in "${segs[@]}"; do set -- $seg; total=$((total + $1)); done
+
+    ns_cleanup
+    topo_dumbbell 40
+    set -- ${segs[0]}
+    bottleneck rtr v-wan "${2}mbit" bfifo limit "$(bdp_bytes 100 80)"
+    nsx srv iperf3 -s -p 5201 -D
+    nsx srv iperf3 -s -p 5202 -D
+    rm -f "$OUT/$tag".*
+    sleep 1
+
+    bpftrace -q -e '
+kprobe:spline_main /nsecs - @last[arg0] >= 10000000/
+{
+    @last[arg0] = nsecs;
+    $scc = (struct scc *)(arg0 + offsetof(struct inet_connection_sock, icsk_ca_priv));
+    printf("%llu,%llu,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u\n", nsecs, arg0,
+        $scc->bw, $scc->curr_ack, $scc->last_min_rtt, $scc->curr_rtt,
+        $scc->lt_bw, $scc->lt_use_bw, $scc->xt_share, $scc->loss_cnt,
+        $scc->current_mode, ((struct tcp_sock *)arg0)->mss_cache, $scc->bw_var);
+}
+END { clear(@last); }' > "$OUT/$tag.samples.csv" &
+    local bt=$!
+    sample_backlog > "$OUT/$tag.qdelay.csv" &
+    local qs=$!
+    sleep 2
+
+    log "$tag: ${total}s"
+    nsx cli iperf3 -c "$SRV_IP" -p 5201 -C spline -t "$total" > "$OUT/$tag.iperf.log" &
+    local flow=$!
+    for seg in "${segs[@]}"; do
+        set -- $seg
+        apply "$tag" "$@"
+        sleep "$1"
+    done
+    wait $flow
+    kill $qs
+    kill -INT $bt
+    wait $bt 2>/dev/null
+
+    local cross=()
+    if [ -s "$OUT/$tag.cross.json" ]; then
+        cross_series "$OUT/$tag.cross.json" "$OUT/$tag.cross.start" > "$OUT/$tag.cross.csv"
+        cross=(--cross "$OUT/$tag.cross.csv")
+    fi
+    python3 "$BENCH_DIR/estimator_report.py" --scenario "$tag" \
+        --samples "$OUT/$tag.samples.csv" --truth "$OUT/$tag.truth.csv" \
+        --qdelay "$OUT/$tag.qdelay.csv" "${cross[@]}" --csv "$OUT/estimators.csv" |
+        tee -a "$OUT/report.md"
+}
+
+for s in $SCENARIOS; do
+    [ -n "${SCHEDULE[$s]:-}" ] || die "unknown scenario '$s'"
+    run_one "$s"
+done
+log "report in $OUT/report.md"
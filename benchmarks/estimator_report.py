@@ -0,0 +1,205 @@
+#!/usr/bin/env python3
+"""Score Spline's estimators against the ground truth of an emulated path.
+
+  estimator_report.py --samples S.csv --truth T.csv [--qdelay Q.csv]
+                      [--cross X.csv] --scenario NAME [--csv OUT.csv]
+
+S.csv  bpftrace samples: ns,sk,bw,curr_ack,last_min_rtt,curr_rtt,lt_bw,
+       lt_use_bw,xt_share,loss_cnt,mode,mss,bw_var
+T.csv  schedule: ns,capacity_mbit,base_rtt_ms,cross_mbit,policer_mbit
+Q.csv  bottleneck backlog samples: ns,backlog_bytes
+X.csv  measured competitor goodput: ns,mbit (for responsive cross traffic)
+
+For every estimator the report gives, over the steady part of each
+schedule segment (the first SETTLE seconds after a change are skipped):
+  bias   mean relative error in percent
+  cv     standard deviation of the relative error in percent
+  lag    median time after a change until the estimate stays within
+         +-TOL of the new truth for HOLD seconds ("-" if it never does)
+xt_share is a fraction that is often truly 0, so instead of a relative
+error it is reported as its mean per segment next to the true cross-traffic
+share, and as the correlation between the two. The standard deviation the
+bw filter claims for itself (sqrt of bw_var) is printed next to the cv it
+actually achieves.
+"""
+
+import argparse
+import bisect
+import csv
+import os
+import statistics
+import sys
+
+BW_UNIT = 1 << 24
+SETTLE = 2.0
+TOL = 0.10
+HOLD = 1.0
+
+
+def load(path, cast=float):
+    with open(path) as f:
+        return [[cast(x) for x in row] for row in csv.reader(f) if row and row[0][0].isdigit()]
+
+
+def step_lookup(rows):
+    keys = [r[0] for r in rows]
+
+    def at(t):
+        i = bisect.bisect_right(keys, t) - 1
+        return rows[max(i, 0)]
+    return at, keys
+
+
+def series_lookup(rows, col=1):
+    if not rows:
+        return lambda t: 0.0
+    keys = [r[0] for r in rows]
+
+    def at(t):
+        i = bisect.bisect_right(keys, t) - 1
+        return rows[max(i, 0)][col]
+    return at
+
+
+def estimators(s):
+    """Physical values of one sample: rates in Mbit/s, times in ms."""
+    _ns, _sk, bw, curr_ack, min_rtt, curr_rtt, lt_bw, lt_use, xt, _loss, _mode, mss, bw_var = s
+    pkt = lambda q24: q24 * mss * 1e6 / BW_UNIT * 8 / 1e6
+    min_rtt = min_rtt or 1
+    return {
+        "scc->bw": pkt(bw),
+        "bandwidth()": curr_ack * 1e6 / min_rtt * 8 / 1e6,
+        "lt_bw": pkt(lt_bw) if lt_use else None,
+        "last_min_rtt": min_rtt / 1e3,
+        "curr_rtt": curr_rtt / 1e3,
+        "xt_share": xt / 256,
+        "bw_sd": (bw_var / 65536) ** 0.5,
+    }
+
+
+def truths(t, sched, qdelay, cross):
+    _, cap, rtt, xmbit, police = sched(t)
+    if cross is not None:
+        xmbit = cross(t)
+    avail = max(cap - xmbit, 0.0)
+    if police:
+        avail = min(avail, police)
+    return {
+        "scc->bw": avail,
+        "bandwidth()": avail,
+        "lt_bw": police or avail,
+        "last_min_rtt": rtt,
+        "curr_rtt": rtt + (qdelay(t) * 8 / (cap * 1e6) * 1e3 if cap else 0.0),
+        "share": xmbit / cap if cap else 0.0,
+    }
+
+
+def lag_after(change, samples, t_next):
+    inside_since = None
+    for t, est, tru in samples:
+        if t < change or t >= t_next:
+            continue
+        ok = est is not None and tru and abs(est - tru) <= TOL * tru
+        if ok and inside_since is None:
+            inside_since = t
+        elif not ok:
+            inside_since = None
+        if inside_since is not None and t - inside_since >= HOLD * 1e9:
+            return inside_since - change
+    return None
+
+
+def corr(xs, ys):
+    if len(xs) < 3 or statistics.pstdev(xs) == 0 or statistics.pstdev(ys) == 0:
+        return float("nan")
+    mx, my = statistics.fmean(xs), statistics.fmean(ys)
+    cov = sum((x - mx) * (y - my) for x, y in zip(xs, ys)) / len(xs)
+    return cov / (statistics.pstdev(xs) * statistics.pstdev(ys))
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument("--samples", required=True)
+    p.add_argument("--truth", required=True)
+    p.add_argument("--qdelay")
+    p.add_argument("--cross")
+    p.add_argument("--scenario", required=True)
+    p.add_argument("--csv")
+    a = p.parse_args()
+
+    raw = load(a.samples)
+    if not raw:
+        sys.exit("no samples")
+    # The flow under test is the socket with the most samples (iperf3 also
+    # opens an almost idle control connection).
+    counts = {}
+    for s in raw:
+        counts[s[1]] = counts.get(s[1], 0) + 1
+    main_sk = max(counts, key=counts.get)
+    raw = [s for s in raw if s[1] == main_sk]
+
+    sched_rows = load(a.truth)
+    sched, changes = step_lookup(sched_rows)
+    qdelay = series_lookup(load(a.qdelay)) if a.qdelay else (lambda t: 0.0)
+    cross = series_lookup(load(a.cross)) if a.cross else None
+    t0 = sched_rows[0][0]
+    t_end = raw[-1][0]
+    bounds = changes[1:] + [t_end + 1]
+
+    per = {}
+    xts, share, bw_sd = [], [], []
+    for s in raw:
+        t = s[0]
+        est, tru = estimators(s), truths(t, sched, qdelay, cross)
+        xts.append(est["xt_share"])
+        bw_sd.append(est["bw_sd"])
+        share.append(tru["share"])
+        for k in ("scc->bw", "bandwidth()", "lt_bw", "last_min_rtt", "curr_rtt"):
+            per.setdefault(k, []).append((t, est[k], tru[k]))
+
+    out = []
+    for k, samples in per.items():
+        errs = []
+        for t, est, tru in samples:
+            i = bisect.bisect_right(changes, t) - 1
+            if est is None or not tru or t - changes[max(i, 0)] < SETTLE * 1e9:
+                continue
+            errs.append((est - tru) / tru)
+        lags = [lag_after(c, samples, bounds[i]) for i, c in enumerate(changes)]
+        got = [l for l in lags if l is not None]
+        out.append({
+            "scenario": a.scenario, "estimator": k, "samples": len(errs),
+            "bias_pct": 100 * statistics.fmean(errs) if errs else float("nan"),
+            "cv_pct": 100 * statistics.pstdev(errs) if len(errs) > 1 else float("nan"),
+            "lag_ms": statistics.median(got) / 1e6 if got else None,
+            "changes_tracked": f"{len(got)}/{len(lags)}",
+        })
+
+    segs = []
+    for i, c in enumerate(changes):
+        v = [(x, y) for s, x, y in zip(raw, xts, share) if c + SETTLE * 1e9 <= s[0] < bounds[i]]
+        segs.append(f"{statistics.fmean(x for x, _ in v):.2f}/{statistics.fmean(y for _, y in v):.2f}"
+                    if v else "-")
+
+    print(f"## {a.scenario} ({len(raw)} samples, {(t_end - t0) / 1e9:.0f}s)\n")
+    print("| estimator | bias % | cv % | lag ms | changes tracked |")
+    print("|-----------|--------|------|--------|-----------------|")
+    for r in out:
+        lag = f"{r['lag_ms']:.0f}" if r["lag_ms"] is not None else "-"
+        print(f"| `{r['estimator']}` | {r['bias_pct']:+.1f} | {r['cv_pct']:.1f} | {lag} | {r['changes_tracked']} |")
+    print(f"\n`xt_share` mean per segment (estimate/truth): {' '.join(segs)}; "
+          f"correlation with true cross share: {corr(xts, share):+.2f}")
+    print(f"`scc->bw` filter sd (from bw_var): {100 * statistics.fmean(bw_sd):.1f}%\n")
+
+    if a.csv:
+        new = not os.path.exists(a.csv)
+        with open(a.csv, "a", newline="") as f:
+            w = csv.DictWriter(f, fieldnames=list(out[0].keys()))
+            if new:
+                w.writeheader()
+            w.writerows(out)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,106 @@
+#!/usr/bin/env bash
+# Latency under load (RRUL style): bulk flows in both directions through one
+# bottleneck while ICMP, UDP and small TCP request/response latency is
+# measured through the same queue.
+#
+# usage: latency_under_load.sh [-c "spline cubic bbr"] [-r MBIT] [-d RTT_MS]
+#                              [-b "0.5 1 4 16"] [-q] [-P STREAMS]
+#                              [-t SECONDS] [-o OUTDIR]
+#
+#   -b  drop-tail (bfifo) buffer depths, in multiples of the path BDP
+#   -q  skip the fq_codel run (it is on by default)
+#
+# Results go to OUTDIR/latency.csv, one line per (cc, qdisc). Latencies are
+# in ms; idle_icmp_p50 is the unloaded baseline, so the queueing delay a
+# controller induces is the loaded percentile minus that column.
+
+set -u
+. "$(dirname "$0")/lib.sh"
+
+CCS="spline cubic bbr"
+RATE=100
+RTT=40
+DEPTHS="0.5 1 4 16"
+FQ_CODEL=1
+STREAMS=4
+SECS=60
+WARMUP=5
+OUT=${OUT:-$BENCH_DIR/results/latency-$(date +%Y%m%d-%H%M%S)}
+
+while getopts "c:r:d:b:qP:t:o:h" o; do
+    case $o in
+    c) CCS=$OPTARG ;;
+    r) RATE=$OPTARG ;;
+    d) RTT=$OPTARG ;;
+    b) DEPTHS=$OPTARG ;;
+    q) FQ_CODEL=0 ;;
+    P) STREAMS=$OPTARG ;;
+    t) SECS=$OPTARG ;;
+    o) OUT=$OPTARG ;;
+    *) sed -n '2,16p' "$0"; exit 1 ;;
+    esac
+done
+
+require_root
+require ip tc iperf3 ping python3
+mkdir -p "$OUT"
+trap ns_cleanup EXIT
+
+CSV=$OUT/latency.csv
+[ -s "$CSV" ] || echo "cc,qdisc,buffer_bytes,rate_mbit,rtt_ms,up_mbit,down_mbit,icmp_p50,icmp_p90,icmp_p99,udp_p50,udp_p90,udp_p99,tcp_rr_p50,tcp_rr_p90,tcp_rr_p99,udp_loss_pct,idle_icmp_p50" > "$CSV"
+
+BDP=$(bdp_bytes "$RATE" "$RTT")
+
+iperf_mbit() {
+    python3 -c 'import json,sys
+try: print("%.2f" % (json.load(open(sys.argv[1]))["end"]["sum_received"]["bits_per_second"] / 1e6))
+except Exception: print("nan")' "$1"
+}
+
+run_one() {
+    local cc=$1 name=$2 bytes=$3; shift 3
+    local tag=$cc-$name
+
+    ns_cleanup
+    topo_dumbbell "$RTT"
+    cc_select cli "$cc"
+    cc_select srv "$cc"
+    bottleneck rtr v-wan "${RATE}mbit" "$@"
+    bottleneck rtr v-cli "${RATE}mbit" "$@"
+
+    nsx srv iperf3 -s -p 5201 -D
+    nsx srv iperf3 -s -p 5202 -D
+    nsx srv python3 "$BENCH_DIR/latprobe.py" echo --addr "$SRV_IP" &
+    sleep 1
+
+    log "$tag: idle baseline"
+    nsx cli ping -n -i 0.1 -w 5 "$SRV_IP" > "$OUT/$tag.idle.ping"
+
+    log "$tag: ${STREAMS}x up + ${STREAMS}x down for ${SECS}s"
+    nsx cli iperf3 -c "$SRV_IP" -p 5201 -C "$cc" -P "$STREAMS" -t "$SECS" -J > "$OUT/$tag.up.json" &
+    local up=$!
+    nsx cli iperf3 -c "$SRV_IP" -p 5202 -C "$cc" -P "$STREAMS" -t "$SECS" -R -J > "$OUT/$tag.down.json" &
+    local down=$!
+
+    sleep "$WARMUP"
+    local probe_secs=$((SECS - WARMUP - 2))
+    nsx cli ping -n -i 0.1 -w "$probe_secs" "$SRV_IP" > "$OUT/$tag.ping" &
+    nsx cli python3 "$BENCH_DIR/latprobe.py" probe --addr "$SRV_IP" --cc "$cc" \
+        --duration "$probe_secs" --out "$OUT/$tag.probe.json"
+    wait $up $down
+
+    local lat
+    lat=$(python3 "$BENCH_DIR/latprobe.py" stats --ping "$OUT/$tag.ping" \
+        --probe "$OUT/$tag.probe.json" --idle "$OUT/$tag.idle.ping")
+    echo "$cc,$name,$bytes,$RATE,$RTT,$(iperf_mbit "$OUT/$tag.up.json"),$(iperf_mbit "$OUT/$tag.down.json"),$lat" |
+        tee -a "$CSV"
+}
+
+for cc in $CCS; do
+    for m in $DEPTHS; do
+        b=$(awk -v m="$m" -v bdp="$BDP" 'BEGIN {b = int(m * bdp); print b < 3000 ? 3000 : b}')
+        run_one "$cc" "bfifo-${m}bdp" "$b" bfifo limit "$b"
+    done
+    [ "$FQ_CODEL" = 1 ] && run_one "$cc" fq_codel 0 fq_codel
+done
+log "results in $CSV"
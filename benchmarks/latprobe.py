@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+"""Latency probes for latency_under_load.sh.
+
+  latprobe.py echo  --addr A [--port P]
+  latprobe.py probe --addr A [--port P] --duration S [--interval I]
+                    [--cc CC] --out FILE
+  latprobe.py stats --ping PINGLOG --probe FILE [--idle PINGLOG]
+
+"echo" answers UDP datagrams and 64-byte TCP requests on the same port.
+"probe" measures, every interval, the round trip of one UDP datagram and of
+one request/response on a persistent TCP connection (the small-request
+flow), and stores the samples in milliseconds as JSON.
+"stats" prints one CSV fragment with p50/p90/p99 for ICMP (parsed from
+`ping` output), UDP and TCP, UDP loss in percent, and the median ICMP RTT
+of an idle baseline if given.
+"""
+
+import argparse
+import json
+import re
+import socket
+import socketserver
+import sys
+import threading
+import time
+
+REQ = 64
+TIMEOUT = 2.0
+
+
+class UDPEcho(socketserver.BaseRequestHandler):
+    def handle(self):
+        data, sock = self.request
+        sock.sendto(data, self.client_address)
+
+
+class TCPEcho(socketserver.BaseRequestHandler):
+    def handle(self):
+        self.request.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        while True:
+            buf = b""
+            while len(buf) < REQ:
+                chunk = self.request.recv(REQ - len(buf))
+                if not chunk:
+                    return
+                buf += chunk
+            self.request.sendall(buf)
+
+
+class ThreadingUDP(socketserver.ThreadingMixIn, socketserver.UDPServer):
+    allow_reuse_address = True
+
+
+class ThreadingTCP(socketserver.ThreadingMixIn, socketserver.TCPServer):
+    allow_reuse_address = True
+    daemon_threads = True
+
+
+def echo(args):
+    udp = ThreadingUDP((args.addr, args.port), UDPEcho)
+    tcp = ThreadingTCP((args.addr, args.port), TCPEcho)
+    threading.Thread(target=udp.serve_forever, daemon=True).start()
+    tcp.serve_forever()
+
+
+def udp_loop(args, out, end):
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    s.settimeout(TIMEOUT)
+    seq = 0
+    while time.monotonic() < end:
+        t0 = time.monotonic()
+        s.sendto(seq.to_bytes(8, "big"), (args.addr, args.port))
+        try:
+            while True:
+                data, _ = s.recvfrom(64)
+                if int.from_bytes(data[:8], "big") == seq:
+                    out["udp"].append((time.monotonic() - t0) * 1e3)
+                    break
+        except socket.timeout:
+            out["udp_lost"] += 1
+        seq += 1
+        time.sleep(max(0.0, args.interval - (time.monotonic() - t0)))
+
+
+def tcp_loop(args, out, end):
+    s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    if args.cc:
+        s.setsockopt(socket.IPPROTO_TCP, socket.TCP_CONGESTION, args.cc.encode())
+    s.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    s.connect((args.addr, args.port))
+    req = b"\0" * REQ
+    while time.monotonic() < end:
+        t0 = time.monotonic()
+        s.sendall(req)
+        got = 0
+        while got < REQ:
+            chunk = s.recv(REQ - got)
+            if not chunk:
+                return
+            got += len(chunk)
+        out["tcp"].append((time.monotonic() - t0) * 1e3)
+        time.sleep(max(0.0, args.interval - (time.monotonic() - t0)))
+
+
+def probe(args):
+    out = {"udp": [], "udp_lost": 0, "tcp": []}
+    end = time.monotonic() + args.duration
+    th = [threading.Thread(target=f, args=(args, out, end)) for f in (udp_loop, tcp_loop)]
+    for t in th:
+        t.start()
+    for t in th:
+        t.join()
+    with open(args.out, "w") as f:
+        json.dump(out, f)
+
+
+def pct(v, p):
+    if not v:
+        return float("nan")
+    v = sorted(v)
+    return v[min(len(v) - 1, int(round(p / 100.0 * (len(v) - 1))))]
+
+
+def ping_samples(path):
+    with open(path) as f:
+        return [float(m.group(1)) for m in re.finditer(r"time=([\d.]+) ms", f.read())]
+
+
+def stats(args):
+    icmp = ping_samples(args.ping)
+    with open(args.probe) as f:
+        pr = json.load(f)
+    idle = pct(ping_samples(args.idle), 50) if args.idle else float("nan")
+    sent = len(pr["udp"]) + pr["udp_lost"]
+    cols = []
+    for v in (icmp, pr["udp"], pr["tcp"]):
+        cols += [pct(v, 50), pct(v, 90), pct(v, 99)]
+    cols += [100.0 * pr["udp_lost"] / sent if sent else float("nan"), idle]
+    print(",".join(f"{c:.2f}" for c in cols))
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument("mode", choices=("echo", "probe", "stats"))
+    p.add_argument("--addr")
+    p.add_argument("--port", type=int, default=7000)
+    p.add_argument("--duration", type=float, default=30.0)
+    p.add_argument("--interval", type=float, default=0.1)
+    p.add_argument("--cc", default=None)
+    p.add_argument("--out")
+    p.add_argument("--ping")
+    p.add_argument("--probe")
+    p.add_argument("--idle")
+    args = p.parse_args()
+    {"echo": echo, "probe": probe, "stats": stats}[args.mode](args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
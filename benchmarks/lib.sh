@@ -0,0 +1,201 @@
+# Shared helpers for the Spline netns benchmarks. Source it, do not run it.
+#
+# Every benchmark builds its topology out of network namespaces named
+# "$NS_PREFIX-<name>" so that a run never touches the host stack and a
+# crashed run can be cleaned up with ns_cleanup.
+
+NS_PREFIX=${NS_PREFIX:-spl}
+BENCH_DIR=$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)
+
+die() { echo "error: $*" >&2; exit 1; }
+log() { echo "[$(date +%T)] $*" >&2; }
+
+require() {
+    local c
+    for c in "$@"; do
+        command -v "$c" >/dev/null 2>&1 || die "'$c' is required but not installed"
+    done
+}
+
+require_root() { [ "$(id -u)" -eq 0 ] || die "must be run as root"; }
+
+# nsx <ns> <cmd...>: run a command inside a benchmark namespace
+nsx() { local ns=$1; shift; ip netns exec "$NS_PREFIX-$ns" "$@"; }
+
+ns_create() {
+    local n
+    for n in "$@"; do
+        ip netns add "$NS_PREFIX-$n" || die "cannot create netns $NS_PREFIX-$n"
+        nsx "$n" ip link set lo up
+    done
+}
+
+ns_cleanup() {
+    local ns
+    for ns in $(ip netns list 2>/dev/null | awk '{print $1}' | grep "^$NS_PREFIX-"); do
+        ip netns pids "$ns" 2>/dev/null | xargs -r kill 2>/dev/null
+        ip netns del "$ns" 2>/dev/null
+    done
+    return 0
+}
+
+# ns_link <nsA> <addrA/len> <nsB> <addrB/len>
+# The interface in A is named "v-<B>" and the one in B "v-<A>".
+# Offloads are disabled so that the bottleneck sees wire-sized packets and
+# the sender sees one ACK per real segment train, as on a physical link.
+ns_link() {
+    local a=$1 ipa=$2 b=$3 ipb=$4
+    ip link add "v-$b" netns "$NS_PREFIX-$a" type veth peer name "v-$a" netns "$NS_PREFIX-$b" ||
+        die "cannot link $a <-> $b"
+    nsx "$a" ip addr add "$ipa" dev "v-$b"
+    nsx "$b" ip addr add "$ipb" dev "v-$a"
+    nsx "$a" ip link set "v-$b" up
+    nsx "$b" ip link set "v-$a" up
+    if command -v ethtool >/dev/null 2>&1; then
+        nsx "$a" ethtool -K "v-$b" tso off gso off gro off >/dev/null 2>&1
+        nsx "$b" ethtool -K "v-$a" tso off gso off gro off >/dev/null 2>&1
+    fi
+}
+
+ns_forwarding() { nsx "$1" sysctl -qw net.ipv4.ip_forward=1; }
+
+# cc_available <cc>: make sure the congestion control can be selected
+cc_available() {
+    local cc=$1
+    grep -qw "$cc" /proc/sys/net/ipv4/tcp_available_congestion_control && return 0
+    modprobe "tcp_$cc" 2>/dev/null
+    grep -qw "$cc" /proc/sys/net/ipv4/tcp_available_congestion_control ||
+        die "congestion control '$cc' is not available (for spline: insmod tcp_spline.ko)"
+}
+
+# cc_select <ns> <cc>: default congestion control of a namespace
+cc_select() {
+    cc_available "$2"
+    nsx "$1" sysctl -qw net.ipv4.tcp_congestion_control="$2"
+}
+
+# cc_hot_funcs <cc>: per-ACK entry points of a congestion control, used to
+# attribute softirq time to the controller itself
+cc_hot_funcs() {
+    case $1 in
+    spline) echo "spline_main" ;;
+    bbr)    echo "bbr_main" ;;
+    cubic)  echo "cubictcp_cong_avoid cubictcp_acked" ;;
+    reno)   echo "tcp_reno_cong_avoid" ;;
+    *)      die "no hot functions known for '$1'" ;;
+    esac
+}
+
+# cc_cost <seconds> <funcs...>: prints "acks ns" spent in funcs during the window
+cc_cost() {
+    local secs=$1; shift
+    local prog="kprobe:tcp_ack { @acks = count(); }" f
+    for f in "$@"; do
+        prog="$prog
+kprobe:$f { @t[tid] = nsecs; }
+kretprobe:$f /@t[tid]/ { @ns = sum(nsecs - @t[tid]); delete(@t[tid]); }"
+    done
+    prog="$prog
+interval:s:$secs { exit(); }
+END { clear(@t); }"
+    bpftrace -e "$prog" 2>/dev/null |
+        awk '/^@acks:/ {a=$2} /^@ns:/ {n=$2} END {printf "%d %d\n", a, n}'
+}
+
+# softirq_ticks: host-wide softirq time in USER_HZ ticks
+softirq_ticks() { awk '/^cpu / {print $8}' /proc/stat; }
+
+# dev_bytes <ns> <dev> <tx|rx>
+dev_bytes() { nsx "$1" cat "/sys/class/net/$2/statistics/$3_bytes"; }
+
+# bottleneck <ns> <dev> <rate> <qdisc...>
+# Rate-limits dev with HTB and hangs the given leaf qdisc under it, so the
+# queue that builds up is the leaf (bfifo, pfifo, fq_codel, ...).
+bottleneck() {
+    local ns=$1 dev=$2 rate=$3; shift 3
+    nsx "$ns" tc qdisc replace dev "$dev" root handle 1: htb default 1
+    nsx "$ns" tc class add dev "$dev" parent 1: classid 1:1 htb rate "$rate" ceil "$rate"
+    nsx "$ns" tc qdisc add dev "$dev" parent 1:1 handle 10: "$@"
+}
+
+# delay <ns> <dev> <delay>: pure propagation delay, never the bottleneck
+delay() {
+    nsx "$1" tc qdisc replace dev "$2" root netem delay "$3" limit 1000000
+}
+
+# topo_dumbbell <rtt>: cli -- rtr -- wan -- srv
+# rtr holds the bottleneck in both directions (rtr:v-wan towards the server,
+# rtr:v-cli towards the client), wan adds half of the RTT on each side.
+# Delay is kept off the endpoints so TSQ and pacing on the senders behave as
+# on a real host. Sets CLI_IP and SRV_IP.
+topo_dumbbell() {
+    local half
+    half=$(awk -v r="${1%ms}" 'BEGIN {printf "%.3fms", r / 2}')
+    ns_create cli rtr wan srv
+    ns_link cli 10.78.1.1/24 rtr 10.78.1.2/24
+    ns_link rtr 10.78.2.1/24 wan 10.78.2.2/24
+    ns_link wan 10.78.3.1/24 srv 10.78.3.2/24
+    ns_forwarding rtr
+    ns_forwarding wan
+    nsx cli ip route add default via 10.78.1.2
+    nsx srv ip route add default via 10.78.3.1
+    nsx rtr ip route add 10.78.3.0/24 via 10.78.2.2
+    nsx wan ip route add 10.78.1.0/24 via 10.78.2.1
+    delay wan v-rtr "$half"
+    delay wan v-srv "$half"
+    CLI_IP=10.78.1.1
+    SRV_IP=10.78.3.2
+}
+
+# topo_parking_lot <long_rtt> <short_rtt>: two bottlenecks in a row
+#
+#   h0 --\                        /-- s0    h0 -> s0 crosses A and B
+#          r1 ==A==> r2 ==B==> r3            h1 -> s1 crosses A only
+#   h1 --/          /  \          \-- s2    h2 -> s2 crosses B only
+#                 h2    s1
+#
+# The bottlenecks are r1:v-r2 (A) and r2:v-r3 (B); set them up with
+# bottleneck. Each flow gets its RTT on its own access links, half on the
+# router egress towards the receiver and half on the router egress towards
+# the sender, so the bottleneck links carry no delay and hosts none either.
+# Sets H_IP[0..2] and S_IP[0..2].
+topo_parking_lot() {
+    local lh sh
+    lh=$(awk -v r="${1%ms}" 'BEGIN {printf "%.3fms", r / 2}')
+    sh=$(awk -v r="${2%ms}" 'BEGIN {printf "%.3fms", r / 2}')
+    ns_create h0 h1 h2 r1 r2 r3 s0 s1 s2
+    ns_link r1 10.79.1.1/24 r2 10.79.1.2/24
+    ns_link r2 10.79.2.1/24 r3 10.79.2.2/24
+    ns_link h0 10.79.10.1/24 r1 10.79.10.2/24
+    ns_link h1 10.79.11.1/24 r1 10.79.11.2/24
+    ns_link h2 10.79.12.1/24 r2 10.79.12.2/24
+    ns_link r3 10.79.20.1/24 s0 10.79.20.2/24
+    ns_link r2 10.79.21.1/24 s1 10.79.21.2/24
+    ns_link r3 10.79.22.1/24 s2 10.79.22.2/24
+    ns_forwarding r1
+    ns_forwarding r2
+    ns_forwarding r3
+    nsx h0 ip route add default via 10.79.10.2
+    nsx h1 ip route add default via 10.79.11.2
+    nsx h2 ip route add default via 10.79.12.2
+    nsx s0 ip route add default via 10.79.20.1
+    nsx s1 ip route add default via 10.79.21.1
+    nsx s2 ip route add default via 10.79.22.1
+    nsx r1 ip route add default via 10.79.1.2
+    nsx r3 ip route add default via 10.79.2.1
+    nsx r2 ip route add 10.79.10.0/24 via 10.79.1.1
+    nsx r2 ip route add 10.79.11.0/24 via 10.79.1.1
+    nsx r2 ip route add 10.79.20.0/24 via 10.79.2.2
+    nsx r2 ip route add 10.79.22.0/24 via 10.79.2.2
+    delay r3 v-s0 "$lh"
+    delay r1 v-h0 "$lh"
+    delay r2 v-s1 "$sh"
+    delay r1 v-h1 "$sh"
+    delay r3 v-s2 "$sh"
+    delay r2 v-h2 "$sh"
+    H_IP=(10.79.10.1 10.79.11.1 10.79.12.1)
+    S_IP=(10.79.20.2 10.79.21.2 10.79.22.2)
+}
+
+# bdp_bytes <rate in mbit> <rtt in ms>
+bdp_bytes() { awk -v r="$1" -v t="${2%ms}" 'BEGIN {printf "%d", r * 1e6 / 8 * t / 1e3}'; }
@@ -0,0 +1,168 @@
+#!/usr/bin/env bash
+# Loss synchronization: do flows at one bottleneck lose packets in the same
+# bursts, and does Spline's probe desynchronization spread them out?
+#
+# usage: loss_sync.sh [-c "spline cubic bbr"] [-d "0 8"] [-P FLOWS] [-r MBIT]
+#                     [-R RTT_MS] [-b BDP_MULT] [-t SECONDS] [-o OUTDIR]
+#
+#   -d  scc_desync_rounds values for the spline runs, one run per value
+#   -b  bfifo depth of the bottleneck, in multiples of the BDP
+#
+# P flows of one controller share a dumbbell bottleneck. The retransmission
+# counter of every flow (ss) is sampled every 20 ms and binned by the RTT.
+# After a warm-up:
+#   loss_bins   bins in which at least one flow retransmitted
+#   pair_corr   mean Pearson correlation of per-bin retransmissions over
+#               all pairs of flows (0 for independent losses, 1 when every
+#               flow loses in every burst)
+#   burst_frac  mean share of the flows that retransmitted in a loss bin
+#               (1/P when bursts hit one flow, 1 when they hit all)
+# Results go to OUTDIR/loss_sync.csv.
+
+set -u
+. "$(dirname "$0")/lib.sh"
+
+CCS="spline cubic bbr"
+DESYNC="0 8"
+FLOWS=8
+RATE=50
+RTT=40
+MULT=1
+SECS=60
+WARMUP=10
+OUT=${OUT:-$BENCH_DIR/results/loss-sync-$(date +%Y%m%d-%H%M%S)}
+PARAM=/sys/module/tcp_spline/parameters/scc_desync_rounds
+
+while getopts "c:d:P:r:R:b:t:o:h" o; do
+    case $o in
+    c) CCS=$OPTARG ;;
+    d) DESYNC=$OPTARG ;;
+    P) FLOWS=$OPTARG ;;
+    r) RATE=$OPTARG ;;
+    R) RTT=$OPTARG ;;
+    b) MULT=$OPTARG ;;
+    t) SECS=$OPTARG ;;
+    o) OUT=$OPTARG ;;
+    *) sed -n '2,20p' "$0"; exit 1 ;;
+    esac
+done
+
+require_root
+require ip tc ss iperf3 python3
+mkdir -p "$OUT"
+trap ns_cleanup EXIT
+
+CSV=$OUT/loss_sync.csv
+[ -s "$CSV" ] || echo "cc,desync_rounds,flows,rate_mbit,rtt_ms,buffer_bytes,mbit,retrans,loss_bins,pair_corr,burst_frac" > "$CSV"
+
+# sample <file>: retransmission counters of the iperf3 data flows until
+# iperf3 exits; a "T ns" line precedes every ss dump
+sample() {
+    while kill -0 "$IPERF_PID" 2>/dev/null; do
+        echo "T $(date +%s%N)"
+        nsx cli ss -tinH state established '( dport = :5201 )'
+        sleep 0.02
+    done > "$1"
+}
+
+# sync_stats <ss file>: loss_bins, pair_corr, burst_frac
+sync_stats() {
+    python3 - "$1" "$RTT" "$WARMUP" <<'EOF'
+import itertools, re, sys
+raw, rtt_ms, warmup = sys.argv[1], float(sys.argv[2]), float(sys.argv[3])
+t0 = t = None
+flow = None
+series = {}     # local addr -> [(t, retrans total, bytes_acked)]
+for line in open(raw):
+    if line.startswith("T "):
+        t = int(line.split()[1]) / 1e9
+        t0 = t if t0 is None else t0
+    elif not line[:1].isspace():
+        v = line.split()
+        flow = v[2] if len(v) >= 4 else None
+    elif flow and t is not None:
+        r = re.search(r"retrans:\d+/(\d+)", line)
+        a = re.search(r"bytes_acked:(\d+)", line)
+        series.setdefault(flow, []).append(
+            (t - t0, int(r.group(1)) if r else 0, int(a.group(1)) if a else 0))
+# iperf3's control connection carries almost nothing
+series = {f: s for f, s in series.items() if s[-1][2] > 1 << 20}
+width = rtt_ms / 1e3
+bins = {}
+last = 0
+for f, s in series.items():
+    last = max(last, int(s[-1][0] / width))
+    prev = None
+    for ts, rtx, _ in s:
+        if prev is not None and ts >= warmup and rtx > prev:
+            k = int(ts / width)
+            bins.setdefault(k, {}).setdefault(f, 0)
+            bins[k][f] += rtx - prev
+        prev = rtx
+flows = sorted(series)
+keys = sorted(bins)
+if len(flows) < 2 or not keys:
+    print("0,nan,nan")
+    sys.exit()
+span = range(int(warmup / width), last + 1)
+x = {f: [bins.get(k, {}).get(f, 0) for k in span] for f in flows}
+def corr(a, b):
+    n = len(a)
+    ma, mb = sum(a) / n, sum(b) / n
+    va = sum((p - ma) ** 2 for p in a)
+    vb = sum((q - mb) ** 2 for q in b)
+    if not va or not vb:
+        return None
+    return sum((p - ma) * (q - mb) for p, q in zip(a, b)) / (va * vb) ** 0.5
+c = [r for r in (corr(x[f], x[g]) for f, g in itertools.combinations(flows, 2))
+     if r is not None]
+frac = sum(len(bins[k]) for k in keys) / len(keys) / len(flows)
+print("%d,%s,%.3f" % (len(keys), "%.3f" % (sum(c) / len(c)) if c else "nan", frac))
+EOF
+}
+
+summary() {
+    python3 -c 'import json, sys
+try:
+    e = json.load(open(sys.argv[1]))["end"]
+    print("%.2f,%d" % (e["sum_received"]["bits_per_second"] / 1e6,
+                       e["sum_sent"]["retransmits"]))
+except Exception:
+    print("nan,nan")' "$1"
+}
+
+run_one() {
+    local cc=$1 d=$2 buf name=$1${2:+-d$2}
+    buf=$(awk -v m="$MULT" -v b="$(bdp_bytes "$RATE" "$RTT")" 'BEGIN {printf "%d", m * b}')
+
+    ns_cleanup
+    topo_dumbbell "$RTT"
+    bottleneck rtr v-wan "${RATE}mbit" bfifo limit "$buf"
+    cc_select cli "$cc"
+    [ -n "$d" ] && echo "$d" > "$PARAM"
+    nsx srv iperf3 -s -p 5201 -D
+    sleep 1
+
+    log "$cc${d:+ desync $d}: $FLOWS flows, ${RATE}Mbit/s ${RTT}ms, ${buf}B buffer"
+    nsx cli iperf3 -c "$SRV_IP" -p 5201 -P "$FLOWS" -t "$SECS" -J > "$OUT/$name.json" &
+    IPERF_PID=$!
+    sleep 0.5
+    sample "$OUT/$name.ss"
+    wait
+
+    echo "$cc,$d,$FLOWS,$RATE,$RTT,$buf,$(summary "$OUT/$name.json"),$(sync_stats "$OUT/$name.ss")" >> "$CSV"
+}
+
+for cc in $CCS; do
+    if [ "$cc" = spline ]; then
+        [ -w "$PARAM" ] || die "$PARAM missing: load a Spline module with probe desynchronization"
+        old=$(cat "$PARAM")
+        for d in $DESYNC; do
+            run_one spline "$d"
+        done
+        echo "$old" > "$PARAM"
+    else
+        run_one "$cc" ""
+    fi
+done
+log "results in $CSV"
@@ -0,0 +1,100 @@
+#!/usr/bin/env bash
+# Parking lot: RTT fairness across two bottlenecks in a row.
+#
+# usage: parking_lot.sh [-c "spline cubic bbr"] [-r MBIT] [-L "10 40 80"]
+#                       [-S SHORT_RTT_MS] [-b BDP_MULT] [-t SECONDS] [-o OUTDIR]
+#
+#   -L  base RTTs of the long flow, one run per value
+#   -S  base RTT of both cross flows
+#   -b  bfifo depth of each bottleneck, in multiples of the short-flow BDP
+#
+# One long flow crosses both bottlenecks (A and B, same rate), one short
+# cross flow sits on each. The max-min fair share is half the rate for every
+# flow, so long_share (long flow goodput / fair share) shows which RTT class
+# the controller favours: below 1 the short flows win, above 1 the long one.
+# jain is Jain's index over the three normalised goodputs. Results go to
+# OUTDIR/parking_lot.csv.
+
+set -u
+. "$(dirname "$0")/lib.sh"
+
+CCS="spline cubic bbr"
+RATE=50
+LONG_RTTS="10 40 80"
+SHORT_RTT=10
+MULT=2
+SECS=60
+WARMUP=10
+OUT=${OUT:-$BENCH_DIR/results/parking-lot-$(date +%Y%m%d-%H%M%S)}
+
+while getopts "c:r:L:S:b:t:o:h" o; do
+    case $o in
+    c) CCS=$OPTARG ;;
+    r) RATE=$OPTARG ;;
+    L) LONG_RTTS=$OPTARG ;;
+    S) SHORT_RTT=$OPTARG ;;
+    b) MULT=$OPTARG ;;
+    t) SECS=$OPTARG ;;
+    o) OUT=$OPTARG ;;
+    *) sed -n '2,17p' "$0"; exit 1 ;;
+    esac
+done
+
+require_root
+require ip tc iperf3 python3
+mkdir -p "$OUT"
+trap ns_cleanup EXIT
+
+CSV=$OUT/parking_lot.csv
+[ -s "$CSV" ] || echo "cc,rate_mbit,long_rtt_ms,short_rtt_ms,buffer_bytes,long_mbit,cross_a_mbit,cross_b_mbit,long_share,jain" > "$CSV"
+
+# goodput over the steady part of the run, skipping WARMUP seconds
+steady_mbit() {
+    python3 -c 'import json, sys
+try:
+    iv = json.load(open(sys.argv[1]))["intervals"]
+    v = [i["sum"]["bits_per_second"] for i in iv if i["sum"]["start"] >= float(sys.argv[2])]
+    print("%.2f" % (sum(v) / len(v) / 1e6))
+except Exception:
+    print("nan")' "$1" "$WARMUP"
+}
+
+run_one() {
+    local cc=$1 lrtt=$2 buf i
+    buf=$(awk -v m="$MULT" -v b="$(bdp_bytes "$RATE" "$SHORT_RTT")" 'BEGIN {printf "%d", m * b}')
+
+    ns_cleanup
+    topo_parking_lot "$lrtt" "$SHORT_RTT"
+    bottleneck r1 v-r2 "${RATE}mbit" bfifo limit "$buf"
+    bottleneck r2 v-r3 "${RATE}mbit" bfifo limit "$buf"
+    for i in 0 1 2; do
+        cc_select "h$i" "$cc"
+        nsx "s$i" iperf3 -s -p 5201 -D
+    done
+    sleep 1
+
+    log "$cc: long ${lrtt}ms, cross ${SHORT_RTT}ms, ${RATE}Mbit/s, ${buf}B buffers"
+    for i in 0 1 2; do
+        nsx "h$i" iperf3 -c "${S_IP[$i]}" -p 5201 -t "$SECS" -i 1 -J \
+            > "$OUT/$cc-$lrtt.flow$i.json" &
+    done
+    wait
+
+    local long xa xb
+    long=$(steady_mbit "$OUT/$cc-$lrtt.flow0.json")
+    xa=$(steady_mbit "$OUT/$cc-$lrtt.flow1.json")
+    xb=$(steady_mbit "$OUT/$cc-$lrtt.flow2.json")
+    awk -v cc="$cc" -v r="$RATE" -v l="$lrtt" -v s="$SHORT_RTT" -v buf="$buf" \
+        -v g0="$long" -v g1="$xa" -v g2="$xb" 'BEGIN {
+        f = r / 2; x0 = g0 / f; x1 = g1 / f; x2 = g2 / f
+        jain = (x0 + x1 + x2) ^ 2 / (3 * (x0 ^ 2 + x1 ^ 2 + x2 ^ 2))
+        printf "%s,%s,%s,%s,%s,%s,%s,%s,%.3f,%.3f\n", cc, r, l, s, buf, g0, g1, g2, x0, jain
+    }' >> "$CSV"
+}
+
+for lrtt in $LONG_RTTS; do
+    for cc in $CCS; do
+        run_one "$cc" "$lrtt"
+    done
+done
+log "results in $CSV"
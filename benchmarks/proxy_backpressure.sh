@@ -0,0 +1,71 @@
+#!/usr/bin/env bash
+# Proxy backpressure: how much data a buffering split-TCP proxy holds per
+# connection when its client is slow, with and without a Spline link between
+# the backend's sending socket and the proxy's client socket.
+#
+# usage: proxy_backpressure.sh [-r MBIT] [-R RTT_MS] [-B BYTES] [-t SECONDS]
+#                              [-o OUTDIR]
+#
+#   -B  userspace buffer of the proxy per connection (default 64 MiB)
+#
+# The proxy and its backend run in srv (relay.py serve), the backend sends to
+# the proxy over loopback as fast as it may, and the client in cli downloads
+# through the dumbbell bottleneck. The run is repeated without a link and
+# with one written to /proc/net/spline_link of srv. OUTDIR/proxy.csv holds
+# the client goodput and the mean, p50, p99 and max proxy occupancy in KB.
+
+set -u
+. "$(dirname "$0")/lib.sh"
+
+RATE=20
+RTT=40
+BUF=$((64 << 20))
+SECS=60
+OUT=${OUT:-$BENCH_DIR/results/proxy-$(date +%Y%m%d-%H%M%S)}
+# per namespace; the proxy links its sockets in its own one (srv)
+LINK=/proc/net/spline_link
+
+while getopts "r:R:B:t:o:h" o; do
+    case $o in
+    r) RATE=$OPTARG ;;
+    R) RTT=$OPTARG ;;
+    B) BUF=$OPTARG ;;
+    t) SECS=$OPTARG ;;
+    o) OUT=$OPTARG ;;
+    *) sed -n '2,15p' "$0"; exit 1 ;;
+    esac
+done
+
+require_root
+require ip tc python3
+cc_available spline
+[ -w "$LINK" ] || die "$LINK missing: load a Spline module with socket linking"
+mkdir -p "$OUT"
+trap ns_cleanup EXIT
+
+CSV=$OUT/proxy.csv
+[ -s "$CSV" ] || echo "link,rate_mbit,rtt_ms,proxy_buffer,mbit,occ_mean_kb,occ_p50_kb,occ_p99_kb,occ_max_kb" > "$CSV"
+
+run_one() {
+    local mode=$1 link=
+
+    [ "$mode" = on ] && link="--link $LINK"
+    ns_cleanup
+    topo_dumbbell "$RTT"
+    bottleneck rtr v-cli "${RATE}mbit" bfifo limit "$(bdp_bytes "$RATE" "$RTT")"
+    cc_select srv spline
+
+    log "link $mode: ${RATE}Mbit/s ${RTT}ms, proxy buffer ${BUF}B"
+    # shellcheck disable=SC2086
+    nsx srv python3 "$BENCH_DIR/relay.py" serve --addr "$SRV_IP" --buffer "$BUF" \
+        --duration "$SECS" --out "$OUT/$mode.json" $link &
+    sleep 1
+    nsx cli python3 "$BENCH_DIR/relay.py" fetch --addr "$SRV_IP" --duration "$((SECS + 2))"
+    wait
+
+    echo "$mode,$RATE,$RTT,$BUF,$(python3 "$BENCH_DIR/relay.py" stats "$OUT/$mode.json")" >> "$CSV"
+}
+
+run_one off
+run_one on
+log "results in $CSV"
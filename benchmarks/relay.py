@@ -0,0 +1,152 @@
+#!/usr/bin/env python3
+"""Split-TCP relay for proxy_backpressure.sh.
+
+  relay.py serve --addr A [--port P] [--buffer BYTES] [--link FILE]
+                 --duration S --out FILE
+  relay.py fetch --addr A [--port P] --duration S
+  relay.py stats FILE
+
+"serve" runs a buffering proxy and its backend in one process. The backend
+listens on 127.0.0.1:P+1 and sends zeros as fast as it can. The proxy
+accepts one client on A:P, connects to the backend and relays the backend's
+data to the client through a userspace buffer of up to --buffer bytes, the
+way a buffering L7 proxy does. With --link, the backend's sending socket is
+linked to the proxy's client socket by writing both SO_COOKIEs to FILE
+(/proc/net/spline_link of the proxy's own namespace), so Spline paces the
+backend at the client flow's rate. Every 100 ms the proxy records its
+occupancy for the connection: the userspace buffer, the unread bytes of the
+backend socket and the unsent bytes of the client socket.
+"fetch" reads from the proxy for --duration seconds and discards the data.
+"stats" prints one CSV fragment: goodput to the client in Mbit/s and the
+mean, p50, p99 and max occupancy in KB.
+"""
+
+import argparse
+import fcntl
+import json
+import selectors
+import socket
+import struct
+import sys
+import termios
+import threading
+import time
+
+SO_COOKIE = 57
+CHUNK = 1 << 16
+SAMPLE = 0.1
+
+
+def cookie(s):
+    return struct.unpack("Q", s.getsockopt(socket.SOL_SOCKET, SO_COOKIE, 8))[0]
+
+
+def queued(s, req):
+    return struct.unpack("i", fcntl.ioctl(s.fileno(), req, b"\0" * 4))[0]
+
+
+def backend(port, ready):
+    ls = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    ls.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    ls.bind(("127.0.0.1", port))
+    ls.listen(1)
+    s, _ = ls.accept()
+    ready.append(s)
+    data = b"\0" * CHUNK
+    try:
+        while True:
+            s.sendall(data)
+    except OSError:
+        pass
+
+
+def serve(args):
+    ready = []
+    threading.Thread(target=backend, args=(args.port + 1, ready), daemon=True).start()
+    ls = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    ls.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    ls.bind((args.addr, args.port))
+    ls.listen(1)
+    c, _ = ls.accept()
+    b = socket.create_connection(("127.0.0.1", args.port + 1))
+    while not ready:
+        time.sleep(0.01)
+    if args.link:
+        with open(args.link, "w") as f:
+            f.write(f"{cookie(ready[0])} {cookie(c)}\n")
+
+    for s in (b, c):
+        s.setblocking(False)
+    sel = selectors.DefaultSelector()
+    buf = bytearray()
+    out = {"occupancy": [], "bytes": 0, "secs": args.duration}
+    end = time.monotonic() + args.duration
+    next_sample = time.monotonic() + SAMPLE
+    while time.monotonic() < end:
+        if len(buf) < args.buffer:
+            sel.register(b, selectors.EVENT_READ)
+        if buf:
+            sel.register(c, selectors.EVENT_WRITE)
+        for key, _ in sel.select(SAMPLE):
+            if key.fileobj is b:
+                data = b.recv(min(CHUNK, args.buffer - len(buf)))
+                if not data:
+                    end = 0
+                buf += data
+            else:
+                n = c.send(buf[:CHUNK * 4])
+                del buf[:n]
+                out["bytes"] += n
+        for key in list(sel.get_map().values()):
+            sel.unregister(key.fileobj)
+        if time.monotonic() >= next_sample:
+            next_sample += SAMPLE
+            out["occupancy"].append(len(buf) + queued(b, termios.FIONREAD) +
+                                    queued(c, termios.TIOCOUTQ))
+    with open(args.out, "w") as f:
+        json.dump(out, f)
+
+
+def fetch(args):
+    s = socket.create_connection((args.addr, args.port))
+    s.settimeout(1.0)
+    end = time.monotonic() + args.duration
+    while time.monotonic() < end:
+        try:
+            if not s.recv(CHUNK):
+                break
+        except socket.timeout:
+            pass
+
+
+def pct(v, p):
+    v = sorted(v)
+    return v[min(len(v) - 1, int(round(p / 100.0 * (len(v) - 1))))]
+
+
+def stats(args):
+    with open(args.file) as f:
+        r = json.load(f)
+    occ = r["occupancy"] or [0]
+    kb = [x / 1e3 for x in occ]
+    print("%.2f,%.1f,%.1f,%.1f,%.1f" % (r["bytes"] * 8 / r["secs"] / 1e6,
+          sum(kb) / len(kb), pct(kb, 50), pct(kb, 99), max(kb)))
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument("mode", choices=("serve", "fetch", "stats"))
+    p.add_argument("file", nargs="?")
+    p.add_argument("--addr")
+    p.add_argument("--port", type=int, default=7100)
+    p.add_argument("--buffer", type=int, default=64 << 20)
+    p.add_argument("--link")
+    p.add_argument("--duration", type=float, default=30.0)
+    p.add_argument("--out")
+    args = p.parse_args()
+    {"serve": serve, "fetch": fetch, "stats": stats}[args.mode](args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,139 @@
+#!/usr/bin/env bash
+# Connection-density benchmark: cost of the congestion control per ACK and
+# per socket at 10k..1M concurrent flows.
+#
+# usage: scale_conns.sh [-c "spline cubic bbr"] [-n "10000 100000 1000000"]
+#                       [-a ACTIVE_PCT] [-t SECONDS] [-o OUTDIR]
+#
+# Two namespaces joined by an unshaped veth pair, so the active flows run at
+# whatever rate the CPU allows (saturation). For every (cc, conns) pair the
+# script records into OUTDIR/scale.csv:
+#   acks_per_s        ACKs processed by tcp_ack() on the whole host
+#   cc_ns_per_ack     time inside the controller's per-ACK hook (bpftrace)
+#   softirq_us_per_ack  host softirq time divided by ACKs
+#   sndbuf_avg        mean sk_sndbuf (tb) - what sndbuf_expand drives
+#   wqueued_avg       mean bytes queued in the write queue (w)
+#   tcp_mem_per_sock  TCP page-pool usage from sockstat divided by sockets
+#   kmalloc512_per_sock  growth of the kmalloc-512 slab while the flows were
+#                     open, divided by sockets
+#   mbit_s            goodput across the veth
+# The CA private area inside tcp_sock (ICSK_CA_PRIV_SIZE) costs the same for
+# every controller, but every Spline socket also allocates its struct
+# scc_flow, a kmalloc-512 object; kmalloc512_per_sock shows that cost next
+# to the baseline growth of the slab under cubic and bbr.
+
+set -u
+. "$(dirname "$0")/lib.sh"
+
+CCS="spline cubic bbr"
+CONNS="10000 100000 1000000"
+ACTIVE=1
+SECS=30
+OUT=${OUT:-$BENCH_DIR/results/scale-$(date +%Y%m%d-%H%M%S)}
+
+while getopts "c:n:a:t:o:h" o; do
+    case $o in
+    c) CCS=$OPTARG ;;
+    n) CONNS=$OPTARG ;;
+    a) ACTIVE=$OPTARG ;;
+    t) SECS=$OPTARG ;;
+    o) OUT=$OPTARG ;;
+    *) sed -n '2,24p' "$0"; exit 1 ;;
+    esac
+done
+
+require_root
+require ip tc ss bpftrace python3
+mkdir -p "$OUT"
+trap ns_cleanup EXIT
+
+CLK_TCK=$(getconf CLK_TCK)
+CSV=$OUT/scale.csv
+[ -s "$CSV" ] || echo "cc,conns,established,active_pct,acks_per_s,cc_ns_per_ack,softirq_us_per_ack,sndbuf_avg,wqueued_avg,tcp_mem_per_sock,kmalloc512_per_sock,mbit_s" > "$CSV"
+
+sysctl -qw fs.nr_open=$((2 * 1024 * 1024))
+
+# bytes held by active kmalloc-512 objects on the host
+slab_512() { awk '$1 == "kmalloc-512" {print $2 * $4}' /proc/slabinfo; }
+
+run_one() {
+    local cc=$1 n=$2
+    local ports=$(( (n + 59999) / 60000 ))
+    local ready=$OUT/.ready
+
+    ns_cleanup
+    ns_create cli srv
+    ns_link cli 10.77.0.1/24 srv 10.77.0.2/24
+    cc_select cli "$cc"
+    nsx cli sysctl -qw net.ipv4.ip_local_port_range="1024 65535"
+    nsx srv sysctl -qw net.core.somaxconn=65535
+    nsx srv sysctl -qw net.ipv4.tcp_max_syn_backlog=65535
+    nsx srv sysctl -qw net.ipv4.tcp_syncookies=0
+
+    rm -f "$ready"
+    local slab0 slab1
+    slab0=$(slab_512)
+    nsx srv python3 "$BENCH_DIR/connfan.py" serve --addr 10.77.0.2 \
+        --ports "$ports" --conns "$n" &
+    sleep 1
+    log "$cc: opening $n connections over $ports ports"
+    nsx cli python3 "$BENCH_DIR/connfan.py" connect --addr 10.77.0.2 \
+        --ports "$ports" --conns "$n" --active "$ACTIVE" --cc "$cc" \
+        --duration $((SECS + 10)) --ready "$ready" &
+    local cpid=$!
+
+    while [ ! -s "$ready" ]; do
+        kill -0 $cpid 2>/dev/null || { log "$cc: client died while connecting"; return; }
+        sleep 1
+    done
+    local est
+    est=$(cat "$ready")
+    sleep 3
+    slab1=$(slab_512)
+
+    local si0 tx0 si1 tx1 cost
+    si0=$(softirq_ticks)
+    tx0=$(dev_bytes cli v-srv tx)
+    # shellcheck disable=SC2046
+    cost=$(cc_cost "$SECS" $(cc_hot_funcs "$cc"))
+    si1=$(softirq_ticks)
+    tx1=$(dev_bytes cli v-srv tx)
+
+    local mem
+    mem=$(nsx cli ss -tmnH state established |
+        awk 'match($0, /skmem:\([^)]*\)/) {
+                 m = substr($0, RSTART + 6, RLENGTH - 7); split(m, f, ",")
+                 for (i in f) {
+                     if (f[i] ~ /^tb/) tb += substr(f[i], 3)
+                     if (f[i] ~ /^w/)  w  += substr(f[i], 2)
+                 }
+                 n++
+             }
+             END { if (n) printf "%d %d", tb / n, w / n; else printf "0 0" }')
+    local pages
+    pages=$(nsx cli awk '/^TCP:/ {for (i = 1; i < NF; i++) if ($i == "mem") print $(i + 1)}' /proc/net/sockstat)
+
+    wait $cpid 2>/dev/null
+
+    set -- $cost
+    local acks=${1:-0} ccns=${2:-0}
+    set -- $mem
+    awk -v cc="$cc" -v n="$n" -v est="$est" -v act="$ACTIVE" -v secs="$SECS" \
+        -v acks="$acks" -v ccns="$ccns" -v si=$((si1 - si0)) -v hz="$CLK_TCK" \
+        -v tb="$1" -v w="$2" -v pages="${pages:-0}" -v tx=$((tx1 - tx0)) \
+        -v slab=$((${slab1:-0} - ${slab0:-0})) \
+        'BEGIN {
+            a = acks ? acks : 1
+            e = est ? est : 1
+            printf "%s,%d,%d,%d,%.0f,%.1f,%.3f,%d,%d,%.0f,%.0f,%.1f\n", cc, n, est, act,
+                acks / secs, ccns / a, si * 1e6 / hz / a, tb, w,
+                pages * 4096 / e, slab / e, tx * 8 / secs / 1e6
+        }' | tee -a "$CSV"
+}
+
+for n in $CONNS; do
+    for cc in $CCS; do
+        run_one "$cc" "$n"
+    done
+done
+log "results in $CSV"
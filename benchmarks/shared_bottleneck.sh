@@ -0,0 +1,112 @@
+#!/usr/bin/env bash
+# Shared bottleneck: does Spline's RFC 8382 detector put flows that share a
+# bottleneck into one group, and flows behind different ones into different
+# groups?
+#
+# usage: shared_bottleneck.sh [-A MBIT] [-B MBIT] [-P FLOWS] [-L RTT_MS]
+#                             [-S RTT_MS] [-t SECONDS] [-o OUTDIR]
+#
+#   -A, -B  rates of the two bottlenecks (equal rates are the hard case)
+#   -P      Spline flows behind each bottleneck
+#   -L, -S  base RTTs of the flows behind A and behind B
+#
+# Uses the parking-lot topology without the long flow. The detector groups
+# the flows of one namespace, so all flows start in h1: P flows h1 -> s1
+# cross only A, and P flows h1 -> s2 take an extra link from h1 to r2 and
+# cross only B. h1's /proc/net/spline_sbd is read every second; after the
+# warm-up every pair of flows at a bottleneck is scored as right when "same
+# group" matches "same bottleneck". OUTDIR/sbd.csv holds one line per
+# sample, OUTDIR/summary.csv the run.
+
+set -u
+. "$(dirname "$0")/lib.sh"
+
+RATE_A=50
+RATE_B=30
+FLOWS=2
+RTT_A=20
+RTT_B=20
+SECS=60
+WARMUP=10
+OUT=${OUT:-$BENCH_DIR/results/shared-bottleneck-$(date +%Y%m%d-%H%M%S)}
+
+while getopts "A:B:P:L:S:t:o:h" o; do
+    case $o in
+    A) RATE_A=$OPTARG ;;
+    B) RATE_B=$OPTARG ;;
+    P) FLOWS=$OPTARG ;;
+    L) RTT_A=$OPTARG ;;
+    S) RTT_B=$OPTARG ;;
+    t) SECS=$OPTARG ;;
+    o) OUT=$OPTARG ;;
+    *) sed -n '2,18p' "$0"; exit 1 ;;
+    esac
+done
+
+require_root
+require ip tc iperf3 python3
+cc_available spline
+[ -r /proc/net/spline_sbd ] || die "/proc/net/spline_sbd missing: load a Spline module with the detector"
+mkdir -p "$OUT"
+trap ns_cleanup EXIT
+
+ns_cleanup
+# h1 sits on the short-RTT access links; the B path gets RTT_B on its own
+# link into r2 and on s2's. The long flow of the topology is not started.
+topo_parking_lot "$RTT_A" "$RTT_A"
+ns_link h1 10.79.13.1/24 r2 10.79.13.2/24
+nsx h1 ip route add 10.79.22.0/24 via 10.79.13.2
+B_IP=10.79.13.1
+delay r2 v-h1 "$(awk -v r="$RTT_B" 'BEGIN {printf "%.3fms", r / 2}')"
+delay r3 v-s2 "$(awk -v r="$RTT_B" 'BEGIN {printf "%.3fms", r / 2}')"
+bottleneck r1 v-r2 "${RATE_A}mbit" bfifo limit "$(bdp_bytes "$RATE_A" "$RTT_A")"
+bottleneck r2 v-r3 "${RATE_B}mbit" bfifo limit "$(bdp_bytes "$RATE_B" "$RTT_B")"
+cc_select h1 spline
+for i in 1 2; do
+    nsx "s$i" iperf3 -s -p 5201 -D
+done
+sleep 1
+
+log "sbd: A ${RATE_A}Mbit/s ${RTT_A}ms, B ${RATE_B}Mbit/s ${RTT_B}ms, $FLOWS flows each"
+nsx h1 iperf3 -c "${S_IP[1]}" -p 5201 -P "$FLOWS" -t "$SECS" > /dev/null &
+nsx h1 iperf3 -c "${S_IP[2]}" -p 5201 -P "$FLOWS" -t "$SECS" > /dev/null &
+
+rm -f "$OUT/sbd.raw"
+for s in $(seq 1 "$SECS"); do
+    sleep 1
+    nsx h1 sed "1d; s/^/$s /" /proc/net/spline_sbd >> "$OUT/sbd.raw"
+done
+wait
+
+python3 - "$OUT/sbd.raw" "$WARMUP" "${H_IP[1]}" "$B_IP" "$FLOWS" \
+    "$OUT/sbd.csv" "$OUT/summary.csv" <<'EOF'
+import collections, itertools, sys
+raw, warmup, ip_a, ip_b, flows, per_sample, summary = sys.argv[1:]
+side = {ip_a: "A", ip_b: "B"}
+samples = collections.defaultdict(list)
+for line in open(raw):
+    # t id group bottleneck intervals mean var skew freq loss local remote
+    v = line.split()
+    if len(v) != 12:
+        continue
+    b = side.get(v[10].rsplit(":", 1)[0])
+    if b:
+        samples[int(v[0])].append((v[10], b, int(v[2]), int(v[3])))
+right = total = 0
+with open(per_sample, "w") as f:
+    f.write("t,at_bottleneck,groups,pairs,right\n")
+    for t in sorted(samples):
+        at = [s for s in samples[t] if s[3]]
+        r = n = 0
+        for x, y in itertools.combinations(at, 2):
+            n += 1
+            r += (x[1] == y[1]) == (x[2] == y[2])
+        f.write(f"{t},{len(at)},{len({s[2] for s in at})},{n},{r}\n")
+        if t > int(warmup):
+            right, total = right + r, total + n
+with open(summary, "w") as f:
+    f.write("flows_per_bottleneck,pairs,pair_accuracy\n")
+    f.write(f"{flows},{total},{right / total if total else float('nan'):.3f}\n")
+print(f"pair accuracy after warm-up: {right}/{total}")
+EOF
+log "results in $OUT"
@@ -0,0 +1,152 @@
+#!/usr/bin/env bash
+# Soak: one Spline flow held for hours to days while the path cycles through
+# a fixed set of conditions, to catch counters in struct scc that saturate,
+# wrap or latch a branch long after the first minutes.
+#
+# usage: soak.sh [-d DURATION] [-p PHASE_SECONDS] [-i SAMPLE_SECONDS]
+#                [-o OUTDIR]
+#
+#   -d  total run time with an s/m/h/d suffix: 3h, 24h (default), 7d
+#   -p  length of one path condition; the cycle of PHASES repeats until -d
+#   -i  struct scc sampling interval
+#
+# Time is real: the counters under test only move on real ACKs. struct scc
+# and the next_cwnd branch counts (spline_next_cwnd_hook) are sampled with
+# bpftrace, every path change is stamped in phases.csv, and soak_report.py
+# turns both into OUTDIR/report.md. Needs a module built with BTF
+# (CONFIG_DEBUG_INFO_BTF_MODULES) so that bpftrace knows struct scc.
+
+set -u
+. "$(dirname "$0")/lib.sh"
+
+DURATION=24h
+PHASE=600
+INTERVAL=1
+OUT=${OUT:-$BENCH_DIR/results/soak-$(date +%Y%m%d-%H%M%S)}
+
+# "capacity_mbit base_rtt_ms loss_pct cross", where cross is an unresponsive
+# UDP rate in Mbit/s or "tcp" for one CUBIC flow
+PHASES=(
+    "50 40 0 0"
+    "100 20 0 0"
+    "20 80 0 0"
+    "50 40 0.1 0"
+    "50 40 1 0"
+    "100 40 0 50"
+    "50 40 0 tcp"
+)
+
+while getopts "d:p:i:o:h" o; do
+    case $o in
+    d) DURATION=$OPTARG ;;
+    p) PHASE=$OPTARG ;;
+    i) INTERVAL=$OPTARG ;;
+    o) OUT=$OPTARG ;;
+    *) sed -n '2,17p' "$0"; exit 1 ;;
+    esac
+done
+
+secs_of() {
+    case $1 in
+    *d) echo $(( ${1%d} * 86400 )) ;;
+    *h) echo $(( ${1%h} * 3600 )) ;;
+    *m) echo $(( ${1%m} * 60 )) ;;
+    *s) echo "${1%s}" ;;
+    *)  echo "$1" ;;
+    esac
+}
+
+require_root
+require ip tc iperf3 bpftrace python3
+cc_available spline
+mkdir -p "$OUT"
+trap ns_cleanup EXIT
+
+TOTAL=$(secs_of "$DURATION")
+[ "$TOTAL" -ge "$PHASE" ] || die "duration shorter than one phase"
+
+mono_ns() { python3 -c 'import time; print(time.monotonic_ns())'; }
+
+# apply <idx> <cap> <rtt> <loss> <cross>
+apply() {
+    local idx=$1 cap=$2 rtt=$3 loss=$4 cross=$5 half
+    half=$(awk -v r="$rtt" 'BEGIN {printf "%.3fms", r / 2}')
+    nsx rtr tc class change dev v-wan parent 1: classid 1:1 htb rate "${cap}mbit" ceil "${cap}mbit"
+    nsx wan tc qdisc change dev v-rtr root netem delay "$half" limit 1000000
+    nsx wan tc qdisc change dev v-srv root netem delay "$half" loss "${loss}%" limit 1000000
+    case $cross in
+    0) ;;
+    tcp) nsx cli iperf3 -c "$SRV_IP" -p 5202 -C cubic -t "$PHASE" > /dev/null & ;;
+    *)   nsx cli iperf3 -c "$SRV_IP" -p 5202 -u -b "${cross}M" -t "$PHASE" > /dev/null & ;;
+    esac
+    echo "$(mono_ns),$idx,$cap,$rtt,$loss,$cross" >> "$OUT/phases.csv"
+}
+
+ns_cleanup
+topo_dumbbell 40
+set -- ${PHASES[0]}
+bottleneck rtr v-wan "${1}mbit" bfifo limit "$(bdp_bytes 100 80)"
+cc_select cli spline
+nsx srv iperf3 -s -p 5202 -D
+# The bulk flow outlives iperf3's one-day -t limit, so it is a plain
+# socket pair: the sink discards, the source writes until killed.
+nsx srv python3 -c 'import socket
+l = socket.create_server(("", 5201))
+c, _ = l.accept()
+b = bytearray(1 << 20)
+while c.recv_into(b):
+    pass' &
+sleep 1
+rm -f "$OUT/phases.csv"
+
+bpftrace -q -e '
+kprobe:spline_next_cwnd_hook
+{
+    @br[arg0, ((struct spline_cwnd_ctx *)arg1)->branch]++;
+}
+kprobe:spline_main /nsecs - @last[arg0] >= (uint64)$1 * 1000000000/
+{
+    @last[arg0] = nsecs;
+    $tp = (struct tcp_sock *)arg0;
+    $scc = (struct scc *)(arg0 + offsetof(struct inet_connection_sock, icsk_ca_priv));
+    printf("%llu,%llu,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%llu,%llu,%llu,%llu,%llu\n",
+        nsecs, arg0, $tp->delivered, $tp->mss_cache, $tp->lost,
+        $scc->current_mode, $scc->unfair_flag, $scc->stable_flag,
+        $scc->loss_cnt, $scc->high_round, $scc->rtt_epoch, $scc->lost_recent,
+        $scc->flow->sum.backoffs, $scc->flow->sum.wd_resets, $scc->lt_last_stamp, $scc->bw,
+        @br[arg0, 0], @br[arg0, 1], @br[arg0, 2], @br[arg0, 3], @br[arg0, 4]);
+    delete(@br[arg0, 0]);
+    delete(@br[arg0, 1]);
+    delete(@br[arg0, 2]);
+    delete(@br[arg0, 3]);
+    delete(@br[arg0, 4]);
+}
+END { clear(@last); clear(@br); }' "$INTERVAL" > "$OUT/samples.csv" &
+BT=$!
+sleep 2
+
+log "soak: ${TOTAL}s, ${#PHASES[@]} conditions of ${PHASE}s each"
+nsx cli python3 -c 'import socket, sys
+s = socket.create_connection((sys.argv[1], 5201))
+b = bytes(1 << 20)
+while True:
+    s.sendall(b)' "$SRV_IP" &
+FLOW=$!
+
+elapsed=0 idx=0
+while [ "$elapsed" -lt "$TOTAL" ]; do
+    apply "$idx" ${PHASES[$idx]}
+    sleep "$PHASE"
+    elapsed=$((elapsed + PHASE))
+    idx=$(( (idx + 1) % ${#PHASES[@]} ))
+done
+
+kill "$FLOW" 2>/dev/null
+kill -INT "$BT"
+wait "$BT" 2>/dev/null
+
+python3 "$BENCH_DIR/soak_report.py" --samples "$OUT/samples.csv" \
+    --phases "$OUT/phases.csv" --conditions "${#PHASES[@]}" \
+    --throughput "$OUT/throughput.csv" > "$OUT/report.md"
+cat "$OUT/report.md"
+log "report in $OUT/report.md"
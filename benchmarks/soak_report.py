@@ -0,0 +1,197 @@
+#!/usr/bin/env python3
+"""Find saturated, wrapped and latched state in a Spline soak run.
+
+  soak_report.py --samples S.csv --phases P.csv --conditions N
+                 [--throughput OUT.csv]
+
+S.csv  bpftrace samples: ns,sk,delivered,mss,lost,mode,unfair_flag,
+       stable_flag,loss_cnt,high_round,rtt_epoch,lost_recent,backoff_cnt,
+       wd_resets,lt_last_stamp,bw,br_loss,br_unfair,br_max,br_drain,
+       br_unresp
+       (br_* are next_cwnd branch counts since the previous sample)
+P.csv  path changes: ns,condition,capacity_mbit,base_rtt_ms,loss_pct,cross
+
+The report (markdown on stdout) has three parts:
+  counters    per field of struct scc: the first time it reached the top of
+              its range, the share of samples spent there, and every drop
+              that is neither a watchdog reset nor a flag halving (a wrap)
+  latches     per cycle through all conditions: the modes and next_cwnd
+              branches seen; a cycle that sees fewer of them than the first
+              one is reported, as is the longest run in a single mode
+  throughput  goodput per condition in the first cycle against the last,
+              and hourly goodput in --throughput
+"""
+
+import argparse
+import bisect
+import csv
+import statistics
+import sys
+
+MODES = ("START", "PROBE_BW", "PROBE_RTT", "DRAIN")
+BRANCHES = ("LOSS", "UNFAIR", "MAX", "DRAIN", "UNRESP")
+COLS = ("ns", "sk", "delivered", "mss", "lost", "mode", "unfair_flag",
+        "stable_flag", "loss_cnt", "high_round", "rtt_epoch", "lost_recent",
+        "backoff_cnt", "wd_resets", "lt_last_stamp", "bw",
+        "br_loss", "br_unfair", "br_max", "br_drain", "br_unresp")
+
+# field: (top of range, kind)
+#   flag       may drop by a watchdog reset or by halving at the top
+#   level      goes up and down; only a drop from the top to the bottom is a wrap
+#   monotonic  never drops in a live connection
+FIELDS = {
+    "unfair_flag": ((1 << 16) - 1, "flag"),
+    "stable_flag": ((1 << 16) - 1, "flag"),
+    "loss_cnt": ((1 << 8) - 1, "level"),
+    "high_round": ((1 << 6) - 1, "level"),
+    "lost_recent": ((1 << 16) - 1, "level"),
+    "rtt_epoch": ((1 << 16) - 1, "monotonic"),
+    "backoff_cnt": ((1 << 16) - 1, "monotonic"),
+    "wd_resets": ((1 << 16) - 1, "monotonic"),
+    "lt_last_stamp": ((1 << 32) - 1, "monotonic"),
+}
+
+
+def load(path):
+    with open(path) as f:
+        return [row for row in csv.reader(f) if row and row[0][0].isdigit()]
+
+
+def hours(ns, t0):
+    return (ns - t0) / 3.6e12
+
+
+def classify(field, prev, cur, top, kind):
+    a, b = prev[field], cur[field]
+    if b >= a:
+        return None
+    if cur["wd_resets"] > prev["wd_resets"] and kind != "monotonic":
+        return None
+    if kind == "flag" and a // 2 - (a >> 3) <= b <= a // 2 + (a >> 3):
+        return None
+    if kind == "level":
+        return "wrap" if a >= top * 9 // 10 and b <= top // 10 else None
+    return "wrap"
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument("--samples", required=True)
+    p.add_argument("--phases", required=True)
+    p.add_argument("--conditions", type=int, required=True)
+    p.add_argument("--throughput")
+    a = p.parse_args()
+
+    raw = load(a.samples)
+    if not raw:
+        sys.exit("no samples")
+    # The bulk flow is the socket with the most samples.
+    counts = {}
+    for r in raw:
+        counts[r[1]] = counts.get(r[1], 0) + 1
+    main_sk = max(counts, key=counts.get)
+    rows = [dict(zip(COLS, map(int, r))) for r in raw if r[1] == main_sk]
+    phases = [[int(ph[0]), int(ph[1])] + ph[2:] for ph in load(a.phases)]
+    if not phases:
+        sys.exit("no phases")
+    starts = [ph[0] for ph in phases]
+    t0, t_end = rows[0]["ns"], rows[-1]["ns"]
+
+    for r in rows:
+        i = bisect.bisect_right(starts, r["ns"]) - 1
+        r["phase"] = i if i >= 0 else None
+
+    print(f"# Soak report ({hours(t_end, t0):.1f} h, {len(rows)} samples, "
+          f"{len(phases)} phases of {a.conditions} conditions)\n")
+
+    print("## Counters\n")
+    print("| field | range | first at top (h) | samples at top | wraps |")
+    print("|-------|-------|------------------|----------------|-------|")
+    for field, (top, kind) in FIELDS.items():
+        first = next((r["ns"] for r in rows if r[field] >= top), None)
+        at_top = sum(1 for r in rows if r[field] >= top)
+        wraps = [hours(cur["ns"], t0) for prev, cur in zip(rows, rows[1:])
+                 if classify(field, prev, cur, top, kind)]
+        w = ", ".join(f"{h:.2f}h" for h in wraps[:5]) + (" ..." if len(wraps) > 5 else "")
+        print(f"| `{field}` | 0..{top} | {f'{hours(first, t0):.2f}' if first else '-'} | "
+              f"{100 * at_top / len(rows):.1f}% | {w or '-'} |")
+
+    print("\n## Latches\n")
+    cycles = {}
+    for r in rows:
+        if r["phase"] is not None:
+            cycles.setdefault(r["phase"] // a.conditions, []).append(r)
+    seen = []
+    for c, sel in sorted(cycles.items()):
+        modes = {MODES[r["mode"]] if r["mode"] < len(MODES) else str(r["mode"]) for r in sel}
+        br = {name for i, name in enumerate(BRANCHES)
+              if sum(r[f"br_{name.lower()}"] for r in sel)}
+        seen.append((c, hours(sel[0]["ns"], t0), modes, br))
+    print("| cycle | start (h) | modes | next_cwnd branches |")
+    print("|-------|-----------|-------|--------------------|")
+    base_modes, base_br = (seen[0][2], seen[0][3]) if seen else (set(), set())
+    latched = []
+    for c, h, modes, br in seen:
+        mark = ""
+        if len(modes) < len(base_modes) or len(br) < len(base_br):
+            mark = " **latched**"
+            latched.append(h)
+        print(f"| {c} | {h:.2f} | {' '.join(sorted(modes))} | {' '.join(sorted(br))}{mark} |")
+    best, best_mode, run_start = 0, None, rows[0]["ns"]
+    for prev, cur in zip(rows, rows[1:]):
+        if cur["mode"] == prev["mode"]:
+            if cur["ns"] - run_start > best:
+                best, best_mode = cur["ns"] - run_start, cur["mode"]
+        else:
+            run_start = cur["ns"]
+    cycle_h = a.conditions * (phases[1][0] - phases[0][0]) / 3.6e12 if len(phases) > 1 else 0
+    name = MODES[best_mode] if best_mode is not None and best_mode < len(MODES) else "-"
+    print(f"\nLongest run in one mode: {name}, {best / 3.6e12:.2f} h "
+          f"(one cycle of conditions is {cycle_h:.2f} h).")
+    if latched:
+        print(f"First latched cycle starts at {latched[0]:.2f} h.")
+
+    print("\n## Throughput\n")
+    good = {}
+    for prev, cur in zip(rows, rows[1:]):
+        if cur["phase"] is None or cur["phase"] != prev["phase"] or cur["ns"] <= prev["ns"]:
+            continue
+        bits = (cur["delivered"] - prev["delivered"]) % (1 << 32) * cur["mss"] * 8
+        g = good.setdefault(cur["phase"], [0, 0])
+        g[0] += bits
+        g[1] += cur["ns"] - prev["ns"]
+    print("| condition | path | first cycle Mbit/s | last cycle Mbit/s | change |")
+    print("|-----------|------|--------------------|-------------------|--------|")
+    for cond in range(a.conditions):
+        inst = sorted(i for i in good if i % a.conditions == cond and good[i][1])
+        if not inst:
+            continue
+        first, last = inst[0], inst[-1]
+        f = good[first][0] / good[first][1] * 1e3
+        l = good[last][0] / good[last][1] * 1e3
+        _, _, cap, rtt, loss, cross = phases[first]
+        path = f"{cap} Mbit/s {rtt} ms loss {loss}% cross {cross}"
+        ch = f"{100 * (l - f) / f:+.1f}%" if f and last != first else "-"
+        print(f"| {cond} | {path} | {f:.2f} | {l:.2f} | {ch} |")
+
+    if a.throughput:
+        hourly = {}
+        for prev, cur in zip(rows, rows[1:]):
+            h = int(hours(cur["ns"], t0))
+            v = hourly.setdefault(h, [0, 0])
+            v[0] += (cur["delivered"] - prev["delivered"]) % (1 << 32) * cur["mss"] * 8
+            v[1] += cur["ns"] - prev["ns"]
+        with open(a.throughput, "w", newline="") as f:
+            w = csv.writer(f)
+            w.writerow(("hour", "mbit"))
+            for h, (bits, ns) in sorted(hourly.items()):
+                w.writerow((h, f"{bits / ns * 1e3:.2f}" if ns else "nan"))
+        mbits = [bits / ns * 1e3 for bits, ns in hourly.values() if ns]
+        if len(mbits) > 1:
+            print(f"\nHourly goodput: median {statistics.median(mbits):.2f} Mbit/s, "
+                  f"min {min(mbits):.2f}, max {max(mbits):.2f} (per hour in {a.throughput}).")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,141 @@
+#!/usr/bin/env bash
+# Unresponsive cross traffic: does a TCP flow settle at the capacity an
+# unresponsive UDP blast leaves over, or starve or feed the loss?
+#
+# usage: unresponsive_cross.sh [-c "spline cubic bbr"] [-r MBIT] [-R RTT_MS]
+#                              [-u "0.5 0.7 0.9"] [-b BDP_MULT] [-t SECONDS]
+#                              [-o OUTDIR]
+#
+#   -u  UDP rates as fractions of the bottleneck rate, one run per value
+#   -b  bfifo depth of the bottleneck, in multiples of the BDP
+#
+# Dumbbell with one TCP flow and one constant-rate UDP flow (iperf3 -u)
+# through the same bottleneck. residual_mbit is the rate minus what the UDP
+# flow got through; share is the TCP goodput over it (1 is the target, below
+# it the flow starves, above it the UDP flow lost to it). retrans counts the
+# TCP flow's retransmissions. For spline, unresp_pct is the share of
+# next_cwnd decisions taken by the unresponsive-traffic branch (needs
+# bpftrace and BTF, empty otherwise). Results go to OUTDIR/unresponsive.csv.
+
+set -u
+. "$(dirname "$0")/lib.sh"
+
+CCS="spline cubic bbr"
+RATE=50
+RTT=40
+FRACS="0.5 0.7 0.9"
+MULT=1
+SECS=60
+WARMUP=15
+OUT=${OUT:-$BENCH_DIR/results/unresponsive-$(date +%Y%m%d-%H%M%S)}
+
+while getopts "c:r:R:u:b:t:o:h" o; do
+    case $o in
+    c) CCS=$OPTARG ;;
+    r) RATE=$OPTARG ;;
+    R) RTT=$OPTARG ;;
+    u) FRACS=$OPTARG ;;
+    b) MULT=$OPTARG ;;
+    t) SECS=$OPTARG ;;
+    o) OUT=$OPTARG ;;
+    *) sed -n '2,19p' "$0"; exit 1 ;;
+    esac
+done
+
+require_root
+require ip tc iperf3 python3
+mkdir -p "$OUT"
+trap ns_cleanup EXIT
+
+CSV=$OUT/unresponsive.csv
+[ -s "$CSV" ] || echo "cc,rate_mbit,rtt_ms,udp_frac,buffer_bytes,udp_mbit,residual_mbit,tcp_mbit,share,retrans,unresp_pct" > "$CSV"
+
+# goodput over the steady part of the run, skipping WARMUP seconds
+steady_mbit() {
+    python3 -c 'import json, sys
+try:
+    iv = json.load(open(sys.argv[1]))["intervals"]
+    v = [i["sum"]["bits_per_second"] for i in iv if i["sum"]["start"] >= float(sys.argv[2])]
+    print("%.2f" % (sum(v) / len(v) / 1e6))
+except Exception:
+    print("nan")' "$1" "$WARMUP"
+}
+
+# UDP rate that reached the receiver, from the server report in the client JSON
+udp_mbit() {
+    python3 -c 'import json, sys
+try:
+    s = json.load(open(sys.argv[1]))["end"]["sum"]
+    print("%.2f" % (s["bits_per_second"] * (1 - s["lost_percent"] / 100) / 1e6))
+except Exception:
+    print("nan")' "$1"
+}
+
+retrans() {
+    python3 -c 'import json, sys
+try:
+    print(json.load(open(sys.argv[1]))["end"]["sum_sent"]["retransmits"])
+except Exception:
+    print("nan")' "$1"
+}
+
+# unresp_start <file>: counts next_cwnd branches of all Spline sockets
+unresp_start() {
+    bpftrace -q -e '
+kprobe:spline_next_cwnd_hook {
+    $c = (struct spline_cwnd_ctx *)arg1;
+    @all = count();
+    if ($c->branch == 4) { @unresp = count(); }
+}' > "$1" 2>/dev/null &
+    BT_PID=$!
+}
+
+unresp_pct() {
+    awk '/^@all:/ {a = $2} /^@unresp:/ {u = $2}
+        END {if (a) printf "%.1f", 100 * u / a}' "$1"
+}
+
+run_one() {
+    local cc=$1 frac=$2 buf udp name=$1-$2
+    buf=$(awk -v m="$MULT" -v b="$(bdp_bytes "$RATE" "$RTT")" 'BEGIN {printf "%d", m * b}')
+    udp=$(awk -v r="$RATE" -v f="$frac" 'BEGIN {printf "%.2f", r * f}')
+
+    ns_cleanup
+    topo_dumbbell "$RTT"
+    bottleneck rtr v-wan "${RATE}mbit" bfifo limit "$buf"
+    cc_select cli "$cc"
+    nsx srv iperf3 -s -p 5201 -D
+    nsx srv iperf3 -s -p 5202 -D
+    sleep 1
+
+    log "$cc: ${RATE}Mbit/s ${RTT}ms, UDP ${udp}Mbit/s, ${buf}B buffer"
+    BT_PID=
+    if [ "$cc" = spline ] && command -v bpftrace >/dev/null 2>&1; then
+        unresp_start "$OUT/$name.branches"
+    fi
+    nsx cli iperf3 -c "$SRV_IP" -p 5202 -u -b "${udp}M" -t "$((SECS + 2))" -J \
+        > "$OUT/$name.udp.json" &
+    sleep 1
+    nsx cli iperf3 -c "$SRV_IP" -p 5201 -t "$SECS" -i 1 -J > "$OUT/$name.tcp.json"
+    [ -n "$BT_PID" ] && kill -INT "$BT_PID" && wait "$BT_PID"
+    wait
+
+    local u t r p=
+    u=$(udp_mbit "$OUT/$name.udp.json")
+    t=$(steady_mbit "$OUT/$name.tcp.json")
+    r=$(retrans "$OUT/$name.tcp.json")
+    [ -n "$BT_PID" ] && p=$(unresp_pct "$OUT/$name.branches")
+    awk -v cc="$cc" -v rate="$RATE" -v rtt="$RTT" -v f="$frac" -v buf="$buf" \
+        -v u="$u" -v t="$t" -v rx="$r" -v p="$p" 'BEGIN {
+        res = rate - u
+        printf "%s,%s,%s,%s,%s,%s,%.2f,%s,%.3f,%s,%s\n", cc, rate, rtt, f, buf, u,
+            res, t, res > 0 ? t / res : 0, rx, p
+    }' >> "$CSV"
+}
+
+for frac in $FRACS; do
+    for cc in $CCS; do
+        run_one "$cc" "$frac"
+    done
+done
+log "results in $CSV"
@@ -0,0 +1,20 @@
+#!/bin/sh
+# Common settings for the Spline packetdrill scripts, run at the top of each
+# one. Every script runs in its own network namespace (see run.sh), so this
+# only touches that namespace.
+#
+# TLP and F-RTO are off: a tail loss probe would add packets before the RTOs
+# the scripts expect, and scripts that want F-RTO turn it back on.
+
+sysctl -q net.ipv4.tcp_congestion_control=spline &&
+sysctl -q net.ipv4.tcp_timestamps=0 &&
+sysctl -q net.ipv4.tcp_sack=1 &&
+sysctl -q net.ipv4.tcp_early_retrans=0 &&
+sysctl -q net.ipv4.tcp_frto=0 &&
+sysctl -q net.ipv4.tcp_no_metrics_save=1 || exit 1
+
+# One packet per MSS on the wire and no qdisc pacing, so outgoing segments
+# match the scripts one for one.
+ethtool -K tun0 tso off gso off > /dev/null 2>&1
+tc qdisc replace dev tun0 root pfifo > /dev/null 2>&1
+exit 0
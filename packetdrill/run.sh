@@ -0,0 +1,32 @@
+#!/usr/bin/env bash
+# Run the Spline packetdrill scripts, each in a fresh network namespace.
+#
+# usage: run.sh [-v] [script.pkt ...]     (default: every *.pkt here)
+#
+# Needs root, packetdrill in PATH and tcp_spline.ko loaded.
+
+cd "$(dirname "$0")" || exit 1
+
+verbose=
+[ "${1:-}" = -v ] && { verbose=--verbose; shift; }
+[ $# -gt 0 ] || set -- *.pkt
+
+[ "$(id -u)" = 0 ] || { echo "run.sh: must be root" >&2; exit 1; }
+command -v packetdrill > /dev/null || { echo "run.sh: packetdrill not found" >&2; exit 1; }
+grep -qw spline /proc/sys/net/ipv4/tcp_available_congestion_control ||
+    { echo "run.sh: load tcp_spline.ko first" >&2; exit 1; }
+
+failed=0
+for t in "$@"; do
+    TMPDIR=$(mktemp -d /tmp/spline-pkt.XXXXXX) || exit 1
+    export TMPDIR
+    if unshare -n sh -c "ip link set lo up && packetdrill --tolerance_usecs=10000 $verbose $t" \
+        > "/tmp/spline-pkt.$(basename "$t" .pkt).log" 2>&1; then
+        echo "PASS $t"
+    else
+        echo "FAIL $t (log: /tmp/spline-pkt.$(basename "$t" .pkt).log)"
+        failed=$((failed + 1))
+    fi
+    rm -rf "$TMPDIR"
+done
+[ $failed = 0 ]
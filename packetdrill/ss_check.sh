@@ -0,0 +1,86 @@
+#!/bin/sh
+# Checks on the Spline socket of the current namespace that tcp_info does
+# not carry, read back through inet_diag (spline_get_info). Called from the
+# packetdrill scripts as a shell command; a non-zero exit fails the script.
+#
+#   ss_check.sh mode start|probe_bw|probe_rtt|drain
+#   ss_check.sh bw-le BITS_PER_SEC
+#   ss_check.sh save NAME          remember cwnd and pacing rate
+#   ss_check.sh cwnd-eq NAME       cwnd is the one saved under NAME
+#   ss_check.sh pacing-ge NAME     pacing rate did not drop below NAME
+#   ss_check.sh log NAME           append the current pacing gain to NAME
+#   ss_check.sh drain-left NAME    the log under NAME shows DRAIN, and DRAIN
+#                                  never lasts three samples in a row
+#
+# Saved values live in $TMPDIR, which run.sh makes fresh for every script.
+
+STATE=${TMPDIR:-/tmp}/spline-pkt
+
+info() {
+    ss -tinHn state established | tr '\n' ' '
+}
+
+# field <regex prefix>: first number following it
+field() {
+    info | sed -n "s/.*$1\([0-9.][0-9.]*\).*/\1/p"
+}
+
+fail() {
+    echo "ss_check: $*" >&2
+    info >&2
+    echo >&2
+    exit 1
+}
+
+case $1 in
+mode)
+    # Every mode sets its own pacing gain (gains_mode, start_probe).
+    case $2 in
+    start)      want=256 ;;
+    probe_bw)   want=550 ;;
+    probe_rtt)  want=250 ;;
+    drain)      want=100 ;;
+    *)          fail "unknown mode $2" ;;
+    esac
+    got=$(field 'pacing_gain:')
+    [ -n "$got" ] || fail "no pacing_gain"
+    awk -v g="$got" -v w="$want" 'BEGIN { d = g * 256 - w; exit !(d < 0.5 && d > -0.5) }' ||
+        fail "pacing_gain $got, want $want/256 ($2)"
+    ;;
+bw-le)
+    got=$(field 'bbr:(bw:')
+    [ -n "$got" ] || fail "no bw"
+    awk -v g="$got" -v m="$2" 'BEGIN { exit !(g <= m) }' || fail "bw $got > $2"
+    ;;
+save)
+    echo "$(field ' cwnd:') $(field ' pacing_rate ')" > "$STATE.$2"
+    ;;
+cwnd-eq)
+    read -r cwnd _ < "$STATE.$2" || fail "nothing saved as $2"
+    got=$(field ' cwnd:')
+    [ "$got" = "$cwnd" ] || fail "cwnd $got, saved $cwnd"
+    ;;
+pacing-ge)
+    read -r _ rate < "$STATE.$2" || fail "nothing saved as $2"
+    got=$(field ' pacing_rate ')
+    awk -v g="$got" -v r="$rate" 'BEGIN { exit !(g >= r) }' ||
+        fail "pacing_rate $got < saved $rate"
+    ;;
+log)
+    got=$(field 'pacing_gain:')
+    [ -n "$got" ] || fail "no pacing_gain"
+    awk -v g="$got" 'BEGIN { printf "%d\n", g * 256 + 0.5 }' >> "$STATE.$2"
+    ;;
+drain-left)
+    [ -s "$STATE.$2" ] || fail "nothing logged as $2"
+    # bbr_drain_gain is 100. A run of two is possible when the next epoch
+    # boundary (EPOCH_ROUND can be 1) enters DRAIN again right after the exit.
+    awk '$1 == 100 { n++; if (++run > 2) bad = 1; next } { run = 0 }
+         END { exit !(n && !bad) }' "$STATE.$2" ||
+        fail "DRAIN not seen or not left: $(tr '\n' ' ' < "$STATE.$2")"
+    ;;
+*)
+    sed -n '2,16p' "$0"
+    exit 1
+    ;;
+esac
@@ -3,6 +3,17 @@
 #include <linux/init.h>
 #include <net/tcp.h>
 #include <linux/random.h>
+#include <linux/btf.h>
+#include <linux/error-injection.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/sort.h>
+#include <linux/jhash.h>
+#include <linux/pkt_sched.h>
+#include <linux/slab.h>
+#include <net/netns/generic.h>
+#include <linux/nsproxy.h>
+#include <linux/workqueue.h>
 
 #define BW_SCALE_2      24
 #define BW_UNIT (1 << BW_SCALE_2)
@@ -15,6 +26,8 @@
 #define MIN_BW          14480    /* Minimum bandwidth in bytes/sec */
 
 #define SCC_MIN_RTT_WIN_SEC 10
+#define SCC_RTT_SYNC        64      /* Окна DRAIN ради min RTT, по хешу */
+#define SCC_RTT_SYNC_MS     200
 #define SCC_MIN_SEGMENT_SIZE 1448
 #define SCC_MIN_SND_CWND    10
 
@@ -25,35 +38,94 @@ enum spline_cc_mode {
     MODE_DRAIN_PROBE
 };
 
+/* Ветка next_cwnd, которая выбрала окно */
+enum spline_cwnd_branch {
+    SPLINE_CWND_LOSS,       /* сильные потери: остаемся на cwnd Spline */
+    SPLINE_CWND_UNFAIR,     /* конкуренция: сглаженное среднее двух окон */
+    SPLINE_CWND_MAX,        /* max(target_cwnd, cwnd) */
+    SPLINE_CWND_DRAIN,      /* DRAIN: min(target_cwnd, cwnd) */
+    SPLINE_CWND_UNRESP      /* чужой трафик не уступает: 2 BDP по bw */
+};
+
+/* Глубина буфера узкого места, см. scc_buf_update */
+enum spline_buf_class {
+    SPLINE_BUF_UNKNOWN,     /* потерь еще не было, очередь не выше 2 BDP */
+    SPLINE_BUF_SHALLOW,     /* меньше 1/2 BDP */
+    SPLINE_BUF_BDP,
+    SPLINE_BUF_DEEP         /* больше 2 BDP */
+};
+
+/* Входные данные арбитража next_cwnd для BPF-перехвата. Раскладка стабильна:
+    новые поля добавляются только в конец. */
+struct spline_cwnd_ctx {
+    u32 target_cwnd;    /* окно из scc_bdp (сегменты) */
+    u32 curr_cwnd;      /* окно Spline из spline_cwnd_next_gain (сегменты) */
+    u32 cwnd;           /* решение самого next_cwnd */
+    u32 __pad;          /* явное выравнивание tf, всегда 0 */
+    u64 tf;             /* percent_gain, Q24 */
+    u16 unfair_flag;
+    u16 stable_flag;
+    u8 loss_cnt;
+    u8 mode;            /* enum spline_cc_mode */
+    u8 branch;          /* enum spline_cwnd_branch */
+    u8 start_phase;
+    u16 sbd_group;      /* общее узкое место, scc_sbd_group */
+    u8 buf_class;       /* enum spline_buf_class */
+};
+
+/* Итог соединения для spline_conn_end_hook. Новые поля только добавляются в
+    конец; мелкие значения хранятся в u32, чтобы между полями не было дыр
+    выравнивания. Если в spline_init не нашлось памяти под scc_flow,
+    has_flow = 0, и все поля, кроме bytes_*, min_rtt_us и retrans, нулевые. */
+struct spline_conn_summary {
+    u64 bytes_acked;
+    u64 bytes_sent;
+    u64 duration_us;
+    u64 mode_us[4];         /* по enum spline_cc_mode */
+    u64 bw_max;             /* байт/с */
+    u64 bw_median;          /* байт/с, потоковая оценка по раундам */
+    u32 min_rtt_us;
+    u32 qdelay_p90_us;      /* RTT - min RTT, потоковая оценка по ACK */
+    u32 retrans;            /* tp->total_retrans */
+    u32 loss_backoffs;      /* срабатывания loss_backoff_cwnd */
+    u32 lt_policer;         /* сколько раз включался lt_use_bw */
+    u32 wd_resets;
+    u32 has_flow;
+    u32 min_rtt_drains;     /* DRAIN ради min RTT: свои и вместе с группой */
+    u64 buf_bytes;          /* оценка буфера узкого места по bw */
+    u32 buf_class;          /* enum spline_buf_class */
+    u32 random_lost;        /* потери, признанные случайными */
+};
+
 struct scc {
     u32 curr_cwnd;      /* Current congestion window (bytes) */
     u32 last_min_rtt;       /* Minimum RTT (us) */
     u32 last_ack;       /* Last acknowledged bytes */
     u32 curr_ack;       /* Newly delivered bytes */
-    u32 fairness_rat;
     u32 last_rtt;
     u32 curr_rtt;
-    u32 gain;
     u32 cwnd_gain;
-
-    u64 cycle_mstamp;        /* time of this cycle phase start */
-    u32 bw;
+    u32 xt_rate;            /* EWMA темпа отправки, Q24 пакетов/мкс */
+    u32 xt_var;             /* EWMA дисперсии s / xt_rate, Q16 */
+    s32 xt_cov;             /* EWMA ковариации s / xt_rate и xt_ratio, Q16 */
+    u16 xt_ratio;           /* EWMA rcv_interval / snd_interval, Q8 */
+    u16 xt_share;           /* Доля чужого трафика в узком месте, Q8 */
+    u32 bw;                 /* Оценка фильтра bw, Q24 пакетов/мкс */
     u32 lt_bw;
     u32 last_min_rtt_stamp; /* Timestamp for min RTT update */
     u32 lt_last_stamp;       /* LT intvl start: tp->delivered_mstamp */
-    u32 lt_last_lost;        /* LT intvl start: tp->lost */
-    u32 lt_last_wstamp_ns;
+    u32 lt_last_lost;        /* LT intvl start: scc_cong_lost */
+    u32 wd_lost;            /* tp->lost на прошлой границе раунда */
     u32 lt_last_delivered;
-    u32 pacing_gain;
     u32 delivered;
 
+    u16 pacing_gain;        /* Q8, не выше bbr_high_gain */
     u16 rtt_epoch;
     u16 unfair_flag;
     u16 stable_flag;
-    u32 rtt_cnt;
+    u16 bw_var;             /* Относительная дисперсия bw, Q16 */
+    u16 lost_recent;        /* Потери за последние 64-128 раундов */
 
-    u16 epp:6,            /* Epoch cycle counter */
-        EPOCH_ROUND:7;
     u32 lt_use_bw:1,
         current_mode:3,       /* Current mode (START_PROBE, etc.) */
         prev_ca_state:3,    /* Previous TCP_CA state */
@@ -63,7 +135,17 @@ struct scc {
         has_seen_rtt:1,
         high_round:6,
         loss_cnt:8,
-        start_phase:1;
+        start_phase:1,
+        wd_rounds:4,        /* Раундов подряд в залипшем состоянии */
+        drain_rounds:2,     /* Раундов в текущем DRAIN */
+        bw_outliers:2,      /* Выбросов bw подряд */
+        lost_rounds:6,      /* Раунды до деления lost_recent */
+        rtt_forced:1,       /* Окно min RTT истекло, DRAIN ради него уже был */
+        desync:4,           /* Раундов удержания до PROBE_BW, см. scc_desync_arm */
+        desync_on:1,        /* Удержание началось, desync отсчитывается */
+        epp:6,              /* Epoch cycle counter */
+        EPOCH_ROUND:6;      /* не больше 63, см. check_probes */
+    struct scc_flow *flow;  /* Состояние вне scc, см. scc_flow_alloc */
 };
 
 static const u32 bbr_lt_bw_diff = 500;
@@ -81,19 +163,80 @@ static const int bbr_rtt_gain  = 250;
 static const int bbr_drain_gain = 100;
 static const int bbr_start_gain = BBR_UNIT;
 static const int scc_drain_gain = 5646946;
+static const u32 scc_wd_rounds = 8;
+static const u32 scc_drain_max_rounds = 3;
+static const u32 scc_ref_rtt_us = 25000;
+static const u32 scc_xt_gain_lo = 16646946;    /* 0.99, Q24 */
+static const u32 scc_xt_gain_hi = 21989530;    /* 1.31, Q24 */
+static const u32 scc_xt_min_var = 256;         /* разброс s не меньше 1/16 */
+static const u32 scc_bw_q = 256;               /* рост дисперсии bw за раунд, 1/16^2 */
+static const u32 scc_bw_r_rate = 1024;         /* шум delivery rate, 1/8^2 */
+static const u32 scc_bw_r_ack = 4096;          /* шум доставленного за раунд, 1/4^2 */
+static const u32 scc_bw_outliers = 3;
+static const u32 scc_unresp_cwnd_gain = BW_UNIT * 2;
+static const int scc_unresp_probe_gain = BBR_UNIT * 5 / 4;
+static const s32 scc_unresp_beta = -32;        /* -1/8, Q8 */
+static const u32 scc_buf_shallow_gain = BBR_UNIT * 5 / 4;
 
 static u32 bytes_in_flight(struct sock *sk);
+static void scc_summary_lt_policer(struct sock *sk);
+static void scc_summary_min_rtt_drain(struct sock *sk);
+static void scc_summary_backoff(struct sock *sk);
+static void scc_summary_wd_reset(struct sock *sk);
+static u16 scc_sbd_group(struct sock *sk);
+static bool scc_app_probe_sample(struct sock *sk, const struct rate_sample *rs);
+static void scc_unresp_update(struct sock *sk, u64 s, u64 r, s32 du);
+static bool scc_unresp(struct sock *sk);
+static int scc_unresp_gain(struct sock *sk);
+static u32 scc_min_rate(struct sock *sk);
+static u8 scc_buf_class(struct sock *sk);
+static u32 scc_cong_lost(struct sock *sk);
+static u32 scc_buf_cap(struct sock *sk);
+static u32 scc_desync_phase(struct sock *sk);
+static u32 scc_link_cap(struct sock *sk);
+static struct scc_rtt_sync *scc_rtt_syncs(struct sock *sk);
 static void update_last_acked_sacked(struct sock *sk, const struct rate_sample *rs);
 
+/* base RTT относительно опорного scc_ref_rtt_us, Q8, в пределах [1/4, 4] */
+static u32 scc_rtt_ratio(struct sock *sk)
+{
+    struct scc *scc = inet_csk_ca(sk);
+    u64 ratio = div_u64((u64)scc->last_min_rtt << BBR_SCALE, scc_ref_rtt_us);
+
+    return clamp_t(u64, ratio, BBR_UNIT >> 2, BBR_UNIT << 2);
+}
+
+/* Пороги по RTT заданы для опорного RTT: на пути с base RTT 100 мс 1 мс
+    это шум, а на пути с 2 мс - половина RTT. Масштабируем их по base RTT. */
+static u32 scc_rtt_scaled(struct sock *sk, u32 us)
+{
+    return (u64)us * scc_rtt_ratio(sk) >> BBR_SCALE;
+}
+
+/* RTT-fairness: часть gain сверх единицы (очередь, которую поток держит
+    и добавляет пробой) для base RTT выше опорного уменьшается в
+    min_rtt / scc_ref_rtt_us раз. При равной скорости потоки тогда держат
+    в общем буфере одинаково байт, а не пропорционально своему RTT. Потоки
+    с RTT не выше опорного не меняются. unit - единица gain (BBR_UNIT или
+    BW_UNIT). */
+static u32 scc_rtt_fair_gain(struct sock *sk, u32 gain, u32 unit)
+{
+    u32 ratio = scc_rtt_ratio(sk);
+
+    if (gain <= unit || ratio <= BBR_UNIT)
+        return gain;
+    return unit + (u32)div_u64((u64)(gain - unit) << BBR_SCALE, ratio);
+}
+
 /* Проверка на стабильность истории RTT. Увеличивается постепенно с каждой 
     подтвержденний из high_rtt_round, тем самым уменьшая погрешность и
     вероятность ошибочных выводов о перегрузки по истории RTT. */
 static bool check_high_rtt(struct sock *sk)
 {
     struct scc *scc = inet_csk_ca(sk);
-    return ((scc->last_rtt + 1000) < scc->curr_rtt &&
-        (scc->last_rtt + scc->rtt_epoch -
-            ((scc->rtt_epoch * 3) >> 2)) > scc->curr_rtt);
+    return ((scc->last_rtt + scc_rtt_scaled(sk, 1000)) < scc->curr_rtt &&
+        (scc->last_rtt + scc_rtt_scaled(sk, scc->rtt_epoch -
+            ((scc->rtt_epoch * 3) >> 2))) > scc->curr_rtt);
 }
 
 /* Проверка на стабильность истории ACK-ов из структуры sample, проверяет и
@@ -110,12 +253,20 @@ static bool ack_check(struct sock *sk)
 static bool rtt_check(struct sock *sk)
 {
    struct scc *scc = inet_csk_ca(sk);
-   return ((scc->last_min_rtt + 1000) < scc->curr_rtt &&
-    (scc->last_min_rtt + scc->rtt_epoch -
-        ((scc->rtt_epoch * 3) >> 3)) > scc->curr_rtt);
+   return ((scc->last_min_rtt + scc_rtt_scaled(sk, 1000)) < scc->curr_rtt &&
+    (scc->last_min_rtt + scc_rtt_scaled(sk, scc->rtt_epoch -
+        ((scc->rtt_epoch * 3) >> 3))) > scc->curr_rtt);
+}
+
+/* Очереди нет: сглаженный RTT не выше min RTT + 1/8 */
+static bool scc_no_queue(struct sock *sk)
+{
+    struct scc *scc = inet_csk_ca(sk);
+
+    return scc->curr_rtt <= scc->last_min_rtt + (scc->last_min_rtt >> 3);
 }
 
-/*Перевод inflight в байты для расчета inflight_throughput*/
+/*Перевод inflight в байты*/
 static u32 bytes_in_flight(struct sock *sk)
 {
     struct tcp_sock *tp = tcp_sk(sk);
@@ -164,29 +315,38 @@ static void high_rtt_round(struct sock *sk)
         scc->high_round = 0;
 }
 
+/*Флаги считают ACK-и за всю жизнь соединения и через несколько часов дошли бы
+    до U16_MAX. Решения смотрят на их отношение (percent_gain, unfair > stable),
+    поэтому у потолка оба делятся пополам: отношение то же, счет продолжается.*/
+static void scc_halve_flags(struct scc *scc)
+{
+    scc->unfair_flag >>= 1;
+    scc->stable_flag >>= 1;
+}
+
 /*Адаптационные флаги: fairness соединение. Если все условия не выполняются: явные проблемы с сетью(Конкуренция и 
     явная не стабильность из-за перегрузки сети)*/
 static void fairness_check(struct sock *sk)
 {
     struct scc *scc = inet_csk_ca(sk);
-    if(scc->unfair_flag == 1 << 16)
-        scc->unfair_flag = 1 << 16;
-
-    else if(!rtt_check(sk) &&
-        !ack_check(sk) && !check_high_rtt(sk))
+    if(!rtt_check(sk) &&
+        !ack_check(sk) && !check_high_rtt(sk)) {
+        if(scc->unfair_flag == U16_MAX)
+            scc_halve_flags(scc);
         scc->unfair_flag++;
+    }
 }
 
 /*Адаптационные флаги: stable соединение. Если все условия выполняются: постепенная стабилизация сети*/
 static void stable_check(struct sock *sk)
 {
     struct scc *scc = inet_csk_ca(sk);
-    if(scc->stable_flag == 1 << 16)
-        scc->stable_flag = 1 << 16;
-
-    else if(rtt_check(sk) &&
-        ack_check(sk) && check_high_rtt(sk))
+    if(rtt_check(sk) &&
+        ack_check(sk) && check_high_rtt(sk)) {
+        if(scc->stable_flag == U16_MAX)
+            scc_halve_flags(scc);
         scc->stable_flag++;
+    }
 }
 
 /* Учитывает историю потерь и доставленых сегментов. Строгая проверка на потери, но не ключевая*/
@@ -195,12 +355,12 @@ static void loss_rate(struct sock *sk)
     struct tcp_sock *tp = tcp_sk(sk);
     struct scc *scc = inet_csk_ca(sk);
     u32 lost, delivered;
-    u64 tf = percent_gain(scc->lt_last_lost, scc->stable_flag, scc->unfair_flag);
-    lost = tp->lost - scc->lt_last_lost;
+    u64 tf = percent_gain(scc->lost_recent, scc->stable_flag, scc->unfair_flag);
+    lost = scc_cong_lost(sk) - scc->lt_last_lost;
     delivered = tp->delivered - scc->lt_last_delivered;
 
     if((lost << BBR_SCALE) > (delivered >> scc_lt_loss_thresh) &&
-     scc->loss_cnt < 1 << 8) {
+     scc->loss_cnt < (1 << 8) - 1) {
         scc->loss_cnt++;
     }
     if(scc->loss_cnt > 1 && tf > thresh_tf)
@@ -246,16 +406,37 @@ static void bbr_init_pacing_rate_from_rtt(struct sock *sk)
            bbr_bw_to_pacing_rate(sk, bw, scc->pacing_gain));
 }
 
+/* Нижняя граница bw для темпа: MIN_BW в Q24 пакетов/мкс, как было у
+    max(scc->bw, bandwidth()). С mss 1000 это ~854 КБ/с, в DRAIN - 100/256
+    от них. Замер полисера lt_bw не поднимается: темп задает полисер. */
+static u32 scc_pacing_bw(const struct sock *sk, u32 bw)
+{
+    struct scc *scc = inet_csk_ca(sk);
+
+    return scc->lt_use_bw ? bw : max_t(u32, bw, MIN_BW);
+}
+
 /* Pace using current bw estimate and a gain factor. */
 static void bbr_set_pacing_rate(struct sock *sk, u32 bw, int gain)
 {
     struct tcp_sock *tp = tcp_sk(sk);
     struct scc *scc = inet_csk_ca(sk);
-    unsigned long rate = bbr_bw_to_pacing_rate(sk, bw, gain);
-
+    unsigned long rate = bbr_bw_to_pacing_rate(sk, scc_pacing_bw(sk, bw), gain);
+    u32 cap;
+
+    cap = scc_link_cap(sk);
+    if (cap)
+        rate = min_t(unsigned long, rate, max_t(unsigned long, cap,
+            bbr_bw_to_pacing_rate(sk, scc_pacing_bw(sk, 0), BBR_UNIT)));
+    rate = max_t(unsigned long, rate, min_t(unsigned long, scc_min_rate(sk),
+        READ_ONCE(sk->sk_max_pacing_rate)));
     if (unlikely(!scc->has_seen_rtt && tp->srtt_us))
         bbr_init_pacing_rate_from_rtt(sk);
-    if (rate > READ_ONCE(sk->sk_pacing_rate))
+    /* В DRAIN темп опускается ниже bw, иначе очередь не уйдет. Рядом с
+        неуступчивым трафиком - до остатка емкости, см. scc_unresp. В
+        связке - вслед за источником, см. scc_link_update. */
+    if (rate > READ_ONCE(sk->sk_pacing_rate) ||
+        scc->current_mode == MODE_DRAIN_PROBE || scc_unresp(sk) || cap)
         WRITE_ONCE(sk->sk_pacing_rate, rate);
 }
 
@@ -266,7 +447,7 @@ static void scc_reset_lt_bw_sampling_interval(struct sock *sk)
 
     scc->lt_last_stamp = div_u64(tp->delivered_mstamp, USEC_PER_MSEC);
     scc->lt_last_delivered = tp->delivered;
-    scc->lt_last_lost = tp->lost;
+    scc->lt_last_lost = scc_cong_lost(sk);
     scc->lt_rtt_cnt = 0;
 }
 
@@ -281,57 +462,72 @@ static void scc_reset_lt_bw_sampling(struct sock *sk)
     scc_reset_lt_bw_sampling_interval(sk);
 }
 
-/*оценка bw на основе ACK-ов и минимального RTT. Умножение ACK на 10^3 обусловленно тем, 
-    что дает лучший контроль для дальшнейших вычислениях в gain и cwnd_gain*/
-static u64 bandwidth(struct sock *sk)
+/* Множитель окна по доле чужого трафика, Q24: 0.99 без конкуренции и до 1.31,
+    когда узкое место почти целиком занято чужими потоками. Диапазон тот же,
+    что был у fairness_rat, под него настроены spline_max_cwnd и
+    cwnd_loss_phase. */
+static u32 scc_xt_gain(struct sock *sk)
 {
     struct scc *scc = inet_csk_ca(sk);
-    u64 tmp_bw, bw;
-    tmp_bw = (scc->curr_ack << BW_SCALE_2) * 10000;
-    bw = div_u64(tmp_bw, scc->last_min_rtt);
-    bw = max(bw, MIN_BW);
-    return bw;
+
+    return scc_xt_gain_lo + (u32)(((u64)(scc_xt_gain_hi - scc_xt_gain_lo) *
+        scc->xt_share) >> BBR_SCALE);
 }
 
-/*оценка throughput на основе inflight и минимального RTT. Необходим для вычисления fairness_rat*/
-static u32 inflight_throughput(struct sock *sk)
+/* Доля чужого трафика в узком месте (xt_share, Q8). Раз в раунд берется
+    темп отправки s = delivered / snd_interval и r = rcv_interval / snd_interval,
+    то есть s / d. Пока очередь есть, FIFO делит емкость C пропорционально
+    входу: d = C * s / (s + z), где z - чужой трафик, значит r = (s + z) / C.
+    По u = s / xt_rate наклон r равен xt_rate / C, а доля чужих
+    z / (s + z) = 1 - наклон / xt_ratio. Наклон считается скользящей
+    регрессией (EWMA 1/8) по отклонениям от средних, разброс s дают смены
+    режимов и пробы. Без очереди канал не загружен, и доля тает на 1/8 за
+    раунд. */
+static void scc_update_xt_share(struct sock *sk, const struct rate_sample *rs)
 {
     struct scc *scc = inet_csk_ca(sk);
-    u64 tmp_tp, tp;
-    u32 inflight = bytes_in_flight(sk);
-    inflight = inflight ? inflight : 448;
-    tmp_tp = (u64)inflight * 10000;
-    tp = div_u64(tmp_tp, scc->last_min_rtt);
+    u64 s, r, slope;
+    s32 du, dr;
 
-    return (u32)tp;
-}
-
-/*Коэффициент конкуренции. Еще один способ корректировки для max_cwnd и curr_cwnd. 
-    Вычисляется через bw/throughput*/
-static u32 fairness_rat(u64 gamma, u32 beta)
-{
-    u32 fairness_rat;
-    if (!beta)
-    beta = (u32)(gamma >> 2) >> BW_SCALE_2;
-    fairness_rat = (u32)(gamma / beta);
+    if (!scc->round_start || scc->current_mode == MODE_START_PROBE)
+        return;
+    if (scc_no_queue(sk)) {
+        scc->xt_share -= scc->xt_share >> 3;
+        return;
+    }
+    if (rs->is_app_limited || rs->delivered <= 0 ||
+        !rs->snd_interval_us || !rs->rcv_interval_us)
+        return;
 
-    if(fairness_rat < 16646946U)
-        fairness_rat = 16646946U;
-    if(fairness_rat > 21989530U)
-        fairness_rat = 21989530U;
+    s = div_u64((u64)rs->delivered * BW_UNIT, rs->snd_interval_us);
+    s = clamp_t(u64, s, 1, U32_MAX);
+    r = div_u64((u64)rs->rcv_interval_us << BBR_SCALE, rs->snd_interval_us);
+    r = clamp_t(u64, r, 1, U16_MAX);
+    if (!scc->xt_rate) {
+        scc->xt_rate = s;
+        scc->xt_ratio = r;
+        return;
+    }
 
-    return fairness_rat;
-}
+    if (s >= scc->xt_rate)
+        du = min_t(u64, div_u64((s - scc->xt_rate) << BBR_SCALE,
+            scc->xt_rate), BBR_UNIT);
+    else
+        du = -(s32)div_u64((scc->xt_rate - s) << BBR_SCALE, scc->xt_rate);
+    dr = (s32)r - scc->xt_ratio;
 
-static void update_bandwidth(struct sock *sk)
-{
-    struct scc *scc = inet_csk_ca(sk);
-    u32 beta;
-    u64 bw, throughput;
-    bw = bandwidth(sk);
-    throughput = inflight_throughput(sk);
+    scc->xt_rate = scc->xt_rate - (scc->xt_rate >> 3) + (u32)(s >> 3);
+    scc->xt_ratio = max_t(s32, scc->xt_ratio + dr / 8, 1);
+    scc->xt_var = scc->xt_var - (scc->xt_var >> 3) + ((u32)(du * du) >> 3);
+    scc->xt_cov += (du * dr - scc->xt_cov) / 8;
+    scc_unresp_update(sk, s, r, du);
 
-    scc->fairness_rat = fairness_rat(bw, throughput);
+    /* s почти не менялся или r от него не зависит: оценку не трогаем */
+    if (scc->xt_var < scc_xt_min_var || scc->xt_cov <= 0)
+        return;
+    slope = div_u64((u64)scc->xt_cov << BBR_SCALE, scc->xt_var);
+    slope = div_u64(slope << BBR_SCALE, scc->xt_ratio);
+    scc->xt_share = BBR_UNIT - min_t(u64, slope, BBR_UNIT);
 }
 
 static void scc_lt_bw_interval_done(struct sock *sk, u32 bw)
@@ -349,6 +545,7 @@ static void scc_lt_bw_interval_done(struct sock *sk, u32 bw)
             scc->lt_bw = (bw + scc->lt_bw) >> 1;  /* avg 2 intvls */
             scc->lt_use_bw = 1;
             scc->pacing_gain = BBR_UNIT;
+            scc_summary_lt_policer(sk);
             return;
         }
     }
@@ -365,7 +562,7 @@ static void scc_lt_bw_sampling(struct sock *sk, const struct rate_sample *rs)
 
     if (scc->lt_use_bw) {   /* already using long-term rate, lt_bw? */
         if (scc->current_mode == MODE_PROBE_BW && scc->round_start &&
-            ++scc->lt_rtt_cnt >= bbr_lt_bw_max_rtts) {
+            ++scc->lt_rtt_cnt >= bbr_lt_bw_max_rtts + scc_desync_phase(sk)) {
             scc_reset_lt_bw_sampling(sk);    /* stop using lt_bw */
         }
         return;
@@ -395,7 +592,7 @@ static void scc_lt_bw_sampling(struct sock *sk, const struct rate_sample *rs)
         return;
 
     /* Calculate packets lost and delivered in sampling interval. */
-    lost = tp->lost - scc->lt_last_lost;
+    lost = scc_cong_lost(sk) - scc->lt_last_lost;
     delivered = tp->delivered - scc->lt_last_delivered;
     /* Is loss rate (lost/delivered) >= lt_loss_thresh? If not, wait. */
     if (!delivered || (lost << BBR_SCALE) < bbr_lt_loss_thresh * delivered)
@@ -440,23 +637,22 @@ static u32 scc_inflight(struct sock *sk, u32 bw, int gain)
     return inflight;
 }
 
-/*Фигурирует 3 bw: два из способов BBR и один из Spline*/
-static u32 scc_max_bw(const struct sock *sk)
+static u32 scc_bw(const struct sock *sk)
 {
     struct scc *scc = inet_csk_ca(sk);
-    u32 bw_max;
-    if(scc->loss_cnt < 50)
-        bw_max = max(scc->bw, (u32)bandwidth(sk));
-    else
-        bw_max = scc->bw;
-    return bw_max;
+
+    return scc->lt_use_bw ? scc->lt_bw : scc->bw;
 }
 
-static u32 scc_bw(const struct sock *sk)
+/*bw в масштабе, под который настроены spline_gain и spline_cwnd_gain:
+    байты за мкс * 10^4. Считается из общей оценки scc_bw.*/
+static u64 bandwidth(struct sock *sk)
 {
-    struct scc *scc = inet_csk_ca(sk);
+    u64 bw;
 
-    return scc->lt_use_bw ? scc->lt_bw : scc_max_bw(sk);
+    bw = ((u64)scc_bw(sk) * tcp_sk(sk)->mss_cache * 10000) >> BW_SCALE_2;
+    bw = max(bw, MIN_BW);
+    return bw;
 }
 
 static u32 scc_packets_in_net_at_edt(struct sock *sk, u32 inflight_now)
@@ -476,35 +672,59 @@ static u32 scc_packets_in_net_at_edt(struct sock *sk, u32 inflight_now)
     return inflight_at_edt - interval_delivered;
 }
 
-/*в BBR данная функция являлась для обновлении функции bbr_advance_cycle_phase(sk), 
-но здесь обновляет для bw Spline*/
-static bool scc_is_next_cycle_phase(struct sock *sk,
-                    const struct rate_sample *rs)
+/* Шаг фильтра Калмана для bw. Состояние - scc->bw (Q24) и его
+    относительная дисперсия bw_var (Q16, 65536 = 100%^2), шум выборки r в тех
+    же единицах. В относительных единицах фильтр не зависит от скорости
+    канала. Выброс за 3 sigma отбрасывается, но scc_bw_outliers выбросов подряд
+    означают, что bw действительно сменилась: дисперсия поднимается до
+    квадрата расхождения, и фильтр быстро переходит на новый уровень. */
+static void scc_bw_fuse(struct sock *sk, u64 z, u32 r)
 {
-    struct tcp_sock *tp = tcp_sk(sk);
     struct scc *scc = inet_csk_ca(sk);
-    bool is_full_length =
-            tcp_stamp_us_delta(tp->tcp_wstamp_ns, scc->cycle_mstamp) > 1;
-    scc->cycle_mstamp = tp->tcp_wstamp_ns;
-    u64 bw = (u64)scc_bw(sk);
-    u32 inflight = scc_packets_in_net_at_edt(sk, rs->prior_in_flight);
+    u64 x = scc->bw, e, e2;
+    u32 p = scc->bw_var, k;
 
-    if (scc->pacing_gain == BBR_UNIT)
-        return is_full_length;
+    z = clamp_t(u64, z, 1, U32_MAX);
+    if (!x) {
+        scc->bw = z;
+        scc->bw_var = min_t(u32, r, U16_MAX);
+        return;
+    }
 
-    if (scc->pacing_gain > BBR_UNIT)
-        return is_full_length &&
-            (rs->losses ||  /* perhaps pacing_gain*BDP won't fit */
-             inflight >= scc_inflight(sk, bw, scc->pacing_gain));
+    e = z >= x ? z - x : x - z;
+    e2 = min_t(u64, div64_u64(e << BBR_SCALE, x), U16_MAX);
+    e2 *= e2;
+    if (e2 > 9 * ((u64)p + r)) {
+        if (++scc->bw_outliers < scc_bw_outliers)
+            return;
+        p = min_t(u64, e2, U16_MAX);
+    }
+    scc->bw_outliers = 0;
 
-    return is_full_length ||
-        inflight <= scc_inflight(sk, bw, scc->cwnd_gain);
+    k = div_u64((u64)p << 16, (u64)p + r);
+    if (z >= x)
+        x += (e * k) >> 16;
+    else
+        x -= (e * k) >> 16;
+    scc->bw = clamp_t(u64, x, 1, U32_MAX);
+    scc->bw_var = max_t(u32, div64_u64((u64)p * r, (u64)p + r), 1);
 }
 
+/* Две выборки bw с разными моделями шума вместо max(scc->bw, bandwidth()):
+    максимум двух шумных оценок систематически завышает bw и раздувает очередь.
+    - delivery rate (delivered / interval_us) на каждом ACK: шум 1/8 плюс
+      дискретность по числу доставленных пакетов;
+    - доставленное за раунд / длительность раунда (curr_rtt, не меньше min
+      RTT) раз в раунд: шум 1/4. Деление на min RTT завышало бы выборку на
+      очередь, а фильтр Калмана ждет шума с нулевым средним.
+    App-limited выборки обоих видов только поднимают bw (delivery rate -
+    кроме пробы): приложение отдало меньше, чем пропускает путь. Между
+    раундами дисперсия растет на scc_bw_q. */
 static void scc_update_bw(struct sock *sk, const struct rate_sample *rs)
 {
     struct tcp_sock *tp = tcp_sk(sk);
     struct scc *scc = inet_csk_ca(sk);
+    u32 round_delivered = 0, r, n;
     u64 bw;
 
     scc->round_start = 0;
@@ -514,18 +734,128 @@ static void scc_update_bw(struct sock *sk, const struct rate_sample *rs)
     /* See if we've reached the next RTT */
     if (!before(rs->prior_delivered,
         scc->delivered)) {
-        scc->delivered = tp->delivered * SCC_MIN_SEGMENT_SIZE;
-        scc->rtt_cnt++;
+        if (scc->delivered)
+            round_delivered = tp->delivered - scc->delivered;
+        scc->delivered = tp->delivered;
         scc->round_start = 1;
     }
     scc_lt_bw_sampling(sk, rs);
 
+    if (scc->round_start) {
+        scc->bw_var = min_t(u32, scc->bw_var + scc_bw_q, U16_MAX);
+        if (round_delivered && scc->last_min_rtt) {
+            bw = div_u64((u64)round_delivered * BW_UNIT,
+                max(scc->curr_rtt, scc->last_min_rtt));
+            if (!rs->is_app_limited || bw >= scc->bw)
+                scc_bw_fuse(sk, bw, scc_bw_r_ack);
+        }
+    }
+
     bw = div64_long((u64)rs->delivered * BW_UNIT, rs->interval_us);
+    /* app-limited выборка - только нижняя граница bw, кроме пробы */
+    if (rs->delivered && (!rs->is_app_limited || bw >= scc->bw ||
+        scc_app_probe_sample(sk, rs))) {
+        n = min_t(u32, rs->delivered, 256);
+        r = scc_bw_r_rate + 65536U / (n * n);
+        scc_bw_fuse(sk, bw, r);
+    }
+}
+
+/* Синхронный DRAIN ради min RTT. Поток, который уходит в DRAIN один, видит
+    очередь, которую держат остальные потоки в том же узком месте, и min RTT
+    завышается у всех. Поэтому первый поток, у которого истек min RTT,
+    открывает окно на SCC_RTT_SYNC_MS для своей группы SBD (или адреса
+    назначения, пока группы нет), а потоки той же группы с min RTT старше
+    половины окна SCC_MIN_RTT_WIN_SEC уходят в DRAIN вместе с ним. Дальше их
+    окна min RTT истекают одновременно. Номера групп уникальны только внутри
+    сети, поэтому таблица своя у каждой сети (scc_net.rtt_syncs). Блокировки
+    нет: при коллизии хеша или гонке лишний поток сходит в DRAIN. */
+struct scc_rtt_sync {
+    u32 key;
+    u32 until;              /* jiffies */
+};
+
+static u32 scc_rtt_sync_key(struct sock *sk)
+{
+    u16 group = scc_sbd_group(sk);
+
+    if (group)
+        return group;
+    if (sk->sk_family == AF_INET6)
+        return jhash(&sk->__sk_common.skc_v6_daddr,
+            sizeof(sk->__sk_common.skc_v6_daddr), 0) | BIT(31);
+    return jhash_1word(sk->__sk_common.skc_daddr, 0) | BIT(31);
+}
+
+/* Открыто ли окно группы потока; при open окно открывается, если его нет. */
+static bool scc_rtt_sync(struct sock *sk, bool open)
+{
+    u32 key = scc_rtt_sync_key(sk);
+    struct scc_rtt_sync *s = &scc_rtt_syncs(sk)[key % SCC_RTT_SYNC];
+
+    if (READ_ONCE(s->key) == key && before(tcp_jiffies32, READ_ONCE(s->until)))
+        return true;
+    if (!open)
+        return false;
+    WRITE_ONCE(s->until, tcp_jiffies32 + msecs_to_jiffies(SCC_RTT_SYNC_MS));
+    WRITE_ONCE(s->key, key);
+    return true;
+}
+
+static void scc_min_rtt_drain(struct sock *sk)
+{
+    struct scc *scc = inet_csk_ca(sk);
+
+    scc->rtt_forced = 1;
+    scc->current_mode = MODE_DRAIN_PROBE;
+    scc->drain_rounds = 0;
+    scc_summary_min_rtt_drain(sk);
+}
 
-    if (!rs->is_app_limited || bw >= scc_max_bw(sk)) {
-        /* Incorporate new sample into our max bw filter. */
-    scc->bw = bw;
+/* Затишье: ACK app-limited или inflight до него ниже половины BDP. Своей
+    очереди у потока тогда нет, и RTT такого ACK годится как выборка min RTT. */
+static bool scc_low_inflight(struct sock *sk, const struct rate_sample *rs)
+{
+    return rs->is_app_limited ||
+        rs->prior_in_flight < scc_bdp(sk, scc_bw(sk), BW_UNIT >> 1);
+}
+
+/* Окно min RTT продлевают естественные выборки: RTT в затишье не выше min
+    RTT + 1/8 подтверждает min RTT без потери скорости. Когда окно все же
+    истекло, берется первая выборка из затишья, а если его нет - поток один
+    раз уходит в DRAIN (вместе с группой, см. scc_rtt_sync) и берет выборку
+    после него. */
+static void update_min_rtt_sample(struct sock *sk, const struct rate_sample *rs,
+    bool expired)
+{
+    struct scc *scc = inet_csk_ca(sk);
+    bool low = scc_low_inflight(sk, rs);
+    bool old = after(tcp_jiffies32, scc->last_min_rtt_stamp +
+        SCC_MIN_RTT_WIN_SEC * HZ / 2);
+
+    if (rs->rtt_us < scc->last_min_rtt) {
+        scc->last_min_rtt = rs->rtt_us;
+    } else if (rs->is_ack_delayed) {
+        return;
+    } else if (low && rs->rtt_us <= scc->last_min_rtt + (scc->last_min_rtt >> 3)) {
+        /* min RTT подтвержден, само значение не меняется */
+    } else if (!expired && !scc->rtt_forced) {
+        if (old && scc->current_mode != MODE_START_PROBE &&
+            scc_rtt_sync(sk, false))
+            scc_min_rtt_drain(sk);
+        return;
+    } else if (low || scc->current_mode == MODE_START_PROBE ||
+        (scc->rtt_forced && scc->current_mode != MODE_DRAIN_PROBE)) {
+        scc->last_min_rtt = rs->rtt_us;
+    } else {
+        if (!scc->rtt_forced) {
+            scc_rtt_sync(sk, true);
+            scc_min_rtt_drain(sk);
+        }
+        return;
     }
+    scc->last_min_rtt_stamp = tcp_jiffies32;
+    scc->rtt_forced = 0;
 }
 
 static void update_min_rtt(struct sock *sk, const struct rate_sample *rs)
@@ -544,10 +874,8 @@ static void update_min_rtt(struct sock *sk, const struct rate_sample *rs)
 
     if (scc->curr_rtt < scc->last_min_rtt || scc->last_min_rtt == 0) {
         scc->last_min_rtt = scc->curr_rtt;
-    } if (rs && rs->rtt_us > 0 && (rs->rtt_us < scc->last_min_rtt ||
-         (new_min_rtt && !rs->is_ack_delayed))) {
-        scc->last_min_rtt = rs->rtt_us;
-        scc->last_min_rtt_stamp = tcp_jiffies32;
+    } if (rs && rs->rtt_us > 0) {
+        update_min_rtt_sample(sk, rs, new_min_rtt);
     } if (scc->last_min_rtt == 0) {
         scc->last_min_rtt = MIN_RTT_US;
     } if (scc->last_min_rtt > scc->curr_rtt) {
@@ -556,22 +884,70 @@ static void update_min_rtt(struct sock *sk, const struct rate_sample *rs)
     scc->epp++;
 }
 
-/*Максимальное cwnd на основе fairness_rat и предыдущего cwnd*/
+/*Максимальное cwnd на основе доли чужого трафика и предыдущего cwnd*/
 static u32 spline_max_cwnd(struct sock *sk)
 {
     struct scc *scc = inet_csk_ca(sk);
-    u64 tmp, bw;
-    u32 max_could_cwnd, throughput;
-    throughput = inflight_throughput(sk);
-    bw = bandwidth(sk);
+    u64 tmp;
+    u32 max_could_cwnd;
 
-    tmp = ((u64)scc->fairness_rat * (u64)scc->curr_cwnd) >> BW_SCALE_2;
+    tmp = ((u64)scc_xt_gain(sk) * (u64)scc->curr_cwnd) >> BW_SCALE_2;
     max_could_cwnd = (u32)tmp;
     max_could_cwnd = max_could_cwnd ? max_could_cwnd : (SCC_MIN_SND_CWND << 1);
 
     return max_could_cwnd;
 }
 
+__bpf_hook_start();
+
+/* Точка перехвата арбитража cwnd для BPF (fmod_ret). Сама ничего не делает и
+    возвращает 0 - тогда остается решение next_cwnd. Программа может вернуть
+    положительное окно (в сегментах) и тем самым переопределить его для
+    конкретного сокета, не трогая модуль. */
+noinline int spline_next_cwnd_hook(struct sock *sk,
+    const struct spline_cwnd_ctx *ctx)
+{
+    return 0;
+}
+
+/* То же для длины следующей эпохи: epoch_round - случайный выбор
+    check_probes. Положительный ответ заменяет его (не больше 63, это предел
+    epp). */
+noinline int spline_epoch_round_hook(struct sock *sk, u32 epoch_round)
+{
+    return 0;
+}
+
+/* То же для loss_backoff_cwnd: cwnd - окно до сброса, backoff_cwnd - после.
+    Положительный ответ заменяет backoff_cwnd, например cwnd отменяет сброс. */
+noinline int spline_backoff_hook(struct sock *sk, u32 cwnd, u32 backoff_cwnd)
+{
+    return 0;
+}
+
+/* То же для гарантированного минимума темпа сокета: rate - то, что дал
+    профиль по SO_PRIORITY (байт/с, 0 - без гарантии). Положительный ответ
+    заменяет его. Вызывается раз в раунд. */
+noinline int spline_min_rate_hook(struct sock *sk, u32 rate)
+{
+    return 0;
+}
+
+/* Итог соединения, один раз из spline_release. Ничего не возвращает: к ней
+    цепляется fentry/kprobe и отдает sum в userspace (ringbuf, perf).
+    barrier() не дает компилятору выбросить вызов пустой функции. */
+noinline void spline_conn_end_hook(struct sock *sk,
+    const struct spline_conn_summary *sum)
+{
+    barrier();
+}
+
+__bpf_hook_end();
+ALLOW_ERROR_INJECTION(spline_next_cwnd_hook, ERRNO);
+ALLOW_ERROR_INJECTION(spline_epoch_round_hook, ERRNO);
+ALLOW_ERROR_INJECTION(spline_backoff_hook, ERRNO);
+ALLOW_ERROR_INJECTION(spline_min_rate_hook, ERRNO);
+
 static void start_probe(struct sock *sk)
 {
     struct scc *scc = inet_csk_ca(sk);
@@ -579,28 +955,115 @@ static void start_probe(struct sock *sk)
     scc->curr_cwnd = max(scc->curr_cwnd, SCC_MIN_SND_CWND);
 }
 
+/* Рассинхронизация проб. Общая потеря на узком месте бьет все потоки Spline
+    разом: они вместе уходят в PROBE_RTT или DRAIN, вместе защелкивают lt_bw
+    и потом вместе возвращаются в PROBE_BW, так что их bbr_high_gain
+    складываются в периодические всплески потерь. Поэтому после такого
+    события (RTO, уход из PROBE_BW по потерям) поток возвращается в
+    PROBE_BW только через свою фазу: 0..n-1 раундов (своих RTT, то есть
+    оборотов узкого места для этого потока), n = scc_desync_rounds, фаза -
+    от хеша сокета sk_hash. Отсчет идет с первой границы эпохи, на которой
+    поток уже пошел бы в PROBE_BW. Удержание только откладывает этот
+    переход: поток остается в PROBE_RTT, куда его отправили потери, с тем же
+    gain, а в PROBE_RTT сам по себе не переводится. START и DRAIN кончаются
+    по своим условиям и не удерживаются. Взвод, которому нечего откладывать
+    (RTO в PROBE_BW, START или DRAIN), снимается на ближайшей границе эпохи,
+    где поток выбирает PROBE_BW, и не задерживает потом посторонний эпизод
+    PROBE_RTT. Новое событие начинает удержание заново. Выход из lt_bw сдвинут на ту же фазу. 0 выключает. Событиями
+    считаются только переходы: loss_backoff_cwnd срабатывает на каждом ACK
+    и откладывал бы PROBE_BW все время, пока loss_cnt высок. */
+#define SCC_DESYNC_MAX 16   /* фаза до 15, см. desync:4 */
+
+static unsigned int scc_desync_rounds = 8;
+module_param(scc_desync_rounds, uint, 0644);
+MODULE_PARM_DESC(scc_desync_rounds,
+    "Spread of per-flow PROBE_BW re-entry after a shared loss event, in rounds (0 = off, max 16)");
+
+static u32 scc_desync_phase(struct sock *sk)
+{
+    u32 n = min_t(u32, READ_ONCE(scc_desync_rounds), SCC_DESYNC_MAX);
+
+    return n ? reciprocal_scale(sk->sk_hash, n) : 0;
+}
+
+static void scc_desync_arm(struct sock *sk)
+{
+    struct scc *scc = inet_csk_ca(sk);
+
+    scc->desync = scc_desync_phase(sk);
+    scc->desync_on = 0;
+}
+
+/* граница эпохи: true, пока фаза не отсчитана */
+static bool scc_desync_hold(struct sock *sk)
+{
+    struct scc *scc = inet_csk_ca(sk);
+
+    if (!scc->desync)
+        return false;
+    scc->desync_on = 1;
+    return true;
+}
+
+static void scc_desync_update(struct sock *sk)
+{
+    struct scc *scc = inet_csk_ca(sk);
+
+    if (scc->round_start && scc->desync_on && scc->desync && !--scc->desync)
+        scc->desync_on = 0;
+}
+
 static void check_drain_probe(struct sock *sk)
 {
     struct scc *scc = inet_csk_ca(sk);
 
-    if (!rtt_check(sk) && !ack_check(sk) && scc->lt_last_lost >
-        (scc_lt_loss_thresh + 1) * 3 << 1)
+    /* потери от неуступчивого трафика DRAIN не уберет */
+    if (!rtt_check(sk) && !ack_check(sk) && !scc_unresp(sk) &&
+        scc->lost_recent > (scc_lt_loss_thresh + 1) * 3 << 1) {
         scc->current_mode = MODE_DRAIN_PROBE;
+        scc->drain_rounds = 0;
+    }
 }
 
 static void check_epoch_probes_rtt_bw(struct sock *sk)
 {
     struct scc *scc = inet_csk_ca(sk);
-    u64 tf = percent_gain(scc->lt_last_lost, scc->stable_flag, scc->unfair_flag);
-    if(tf < thresh_tf || scc->unfair_flag > scc->stable_flag)
+    u64 tf = percent_gain(scc->lost_recent, scc->stable_flag, scc->unfair_flag);
+    if(tf < thresh_tf || scc->unfair_flag > scc->stable_flag) {
+        if (tf < thresh_tf && scc->current_mode == MODE_PROBE_BW)
+            scc_desync_arm(sk);
         scc->current_mode = MODE_PROBE_RTT;
-    else
+    } else if (scc->current_mode != MODE_PROBE_RTT || !scc_desync_hold(sk)) {
+        scc->desync = 0;
         scc->current_mode = MODE_PROBE_BW;
     }
+    }
+
+/* DRAIN держится, пока inflight на момент EDT выше BDP по текущей оценке bw,
+    но не дольше scc_drain_max_rounds раундов. Дальше режим выбирается как на
+    границе эпохи. */
+static void check_drain_done(struct sock *sk)
+{
+    struct tcp_sock *tp = tcp_sk(sk);
+    struct scc *scc = inet_csk_ca(sk);
+    u32 inflight;
+
+    if (scc->current_mode != MODE_DRAIN_PROBE)
+        return;
+
+    if (scc->round_start)
+        scc->drain_rounds++;
+    inflight = scc_packets_in_net_at_edt(sk, tcp_packets_in_flight(tp));
+    if (inflight <= scc_inflight(sk, scc_bw(sk), BW_UNIT) ||
+        scc->drain_rounds >= scc_drain_max_rounds)
+        check_epoch_probes_rtt_bw(sk);
+}
 
 static void check_probes(struct sock *sk)
 {
     struct scc *scc = inet_csk_ca(sk);
+    u32 epoch_round;
+    int override;
 
     if (scc->epp == scc->EPOCH_ROUND) {
         scc->epp = 0;
@@ -609,7 +1072,10 @@ static void check_probes(struct sock *sk)
             scc->EPOCH_ROUND = 20;
             scc->start_phase = 0;
         } else {
-            scc->EPOCH_ROUND = 1 + (get_random_u32() % 31);
+            epoch_round = 1 + (get_random_u32() % 31);
+            override = spline_epoch_round_hook(sk, epoch_round);
+            scc->EPOCH_ROUND = override > 0 ? min_t(u32, override, 63) :
+                epoch_round;
         }
 
         check_epoch_probes_rtt_bw(sk);
@@ -648,6 +1114,14 @@ static void gains_mode(struct sock *sk)
     default:
         scc->pacing_gain = bbr_high_gain;
     }
+    if (scc_unresp(sk) && scc->current_mode != MODE_DRAIN_PROBE &&
+        scc->current_mode != MODE_START_PROBE)
+        scc->pacing_gain = scc_unresp_gain(sk);
+    /* мелкий буфер: перелет пробы сразу уходит в потери */
+    else if (scc_buf_class(sk) == SPLINE_BUF_SHALLOW &&
+        scc->current_mode != MODE_DRAIN_PROBE &&
+        scc->current_mode != MODE_START_PROBE)
+        scc->pacing_gain = min_t(u32, scc->pacing_gain, scc_buf_shallow_gain);
 }
 
 static u64 cwnd_gain(struct sock *sk)
@@ -667,7 +1141,7 @@ static u64 cwnd_gain(struct sock *sk)
     return cwnd_gain;
 }
 
-static u32 spline_gain(struct sock *sk)
+static u32 spline_gain(struct sock *sk, u32 *gain_out)
 {
     struct tcp_sock *tp = tcp_sk(sk);
     struct scc *scc = inet_csk_ca(sk);
@@ -685,8 +1159,10 @@ static u32 spline_gain(struct sock *sk)
     if(gain < 646946U)
         gain = 646946U;
 
-    scc->gain = gain;
-    scc->cwnd_gain = cwnd_spline_gain;
+    *gain_out = gain;
+    /* в DRAIN cwnd_gain остается scc_drain_gain из gains_mode */
+    if (scc->current_mode != MODE_DRAIN_PROBE)
+        scc->cwnd_gain = cwnd_spline_gain;
 
     /*присвоили gain-ы и возвращаем minRTT*/
     return rtt;
@@ -702,7 +1178,7 @@ static u32 cwnd_loss_phase(struct sock *sk, u64 gain, u32 rtt)
     rtt = (rtt + scc->curr_rtt) >> 1;
 
     cwnd = (u32)(div_u64(gain, (u64)rtt));
-    cwnd = (u32)(((u64)scc->fairness_rat * (u64)cwnd) >> BW_SCALE_2);
+    cwnd = (u32)(((u64)scc_xt_gain(sk) * (u64)cwnd) >> BW_SCALE_2);
     return cwnd;
 } 
 
@@ -719,9 +1195,19 @@ static void loss_backoff_cwnd(struct sock *sk)
 {
     struct scc *scc = inet_csk_ca(sk);
     u32 ls = scc->loss_cnt;
+    u32 cwnd;
+    int override;
     if (ls > 12)  ls = 12;
-    if (ls > 9) {
-        scc->curr_cwnd = (u32)((u64)scc->curr_cwnd * ls * ls * ls) >> ls;
+    /* потери задает чужой трафик, который на наше окно не смотрит */
+    if (ls > 9 && !scc_unresp(sk)) {
+        cwnd = (u32)((u64)scc->curr_cwnd * ls * ls * ls) >> ls;
+        override = spline_backoff_hook(sk, scc->curr_cwnd, cwnd);
+        if (override > 0) {
+            scc->curr_cwnd = override;
+            return;
+        }
+        scc->curr_cwnd = cwnd;
+        scc_summary_backoff(sk);
     }
 }
 
@@ -730,16 +1216,16 @@ static void spline_cwnd_next_gain(struct sock *sk, const struct rate_sample *rs)
     struct tcp_sock *tp = tcp_sk(sk);
     struct scc *scc = inet_csk_ca(sk);
     u64 tf, bw;
-    u32 rtt, cwnd;
+    u32 rtt, cwnd, gain;
     bw = bandwidth(sk);
-    rtt = spline_gain(sk);
+    rtt = spline_gain(sk, &gain);
     cwnd = spline_max_cwnd(sk) >> 3;
-    tf = percent_gain(scc->lt_last_lost, scc->stable_flag, scc->unfair_flag);
+    tf = percent_gain(scc->lost_recent, scc->stable_flag, scc->unfair_flag);
 
     if((scc->unfair_flag > 2000 || !check_high_rtt(sk)) || scc->loss_cnt > 10) {
-        scc->curr_cwnd = cwnd_loss_phase(sk, scc->gain, rtt);
+        scc->curr_cwnd = cwnd_loss_phase(sk, gain, rtt);
     } else {
-        scc->curr_cwnd = cwnd_stable_phase(scc->gain, rtt);
+        scc->curr_cwnd = cwnd_stable_phase(gain, rtt);
     }
 
     loss_backoff_cwnd(sk);
@@ -765,6 +1251,7 @@ static void update_probes(struct sock *sk, const struct rate_sample *rs)
 {
     struct scc *scc = inet_csk_ca(sk);
 
+    check_drain_done(sk);
     check_probes(sk);
     switch (scc->current_mode) {
     case MODE_START_PROBE:
@@ -785,6 +1272,75 @@ static void update_probes(struct sock *sk, const struct rate_sample *rs)
     }
 }
 
+/* Недавние потери для percent_gain и check_drain_probe. Раньше там был
+    tp->lost на начало lt-интервала, то есть все потери соединения: за сутки он
+    только растет, tf навсегда падает ниже порогов, и DRAIN перестает зависеть
+    от потерь. Теперь потери копятся по раундам и делятся пополам каждые 64
+    раунда, так что учитываются последние 64-128 раундов. Вызывается до
+    spline_watchdog: wd_lost - tp->lost на прошлой границе раунда. */
+static void scc_update_lost_recent(struct sock *sk)
+{
+    struct tcp_sock *tp = tcp_sk(sk);
+    struct scc *scc = inet_csk_ca(sk);
+
+    if (!scc->round_start)
+        return;
+
+    scc->lost_recent = min_t(u32, scc->lost_recent + (tp->lost - scc->wd_lost),
+        U16_MAX);
+    if (++scc->lost_rounds == 0)
+        scc->lost_recent >>= 1;
+}
+
+/* Залипшие состояния, из которых Spline сам не выходит. Проверяются только
+    раунды без новых потерь. */
+static bool scc_wedged(struct sock *sk, const struct rate_sample *rs)
+{
+    struct tcp_sock *tp = tcp_sk(sk);
+    struct scc *scc = inet_csk_ca(sk);
+    bool no_queue = scc_no_queue(sk);
+
+    if (tp->lost != scc->wd_lost)
+        return false;
+
+    /* loss_cnt выше 50: next_cwnd держит окно Spline, а потерь нет */
+    if (scc->loss_cnt > 50)
+        return true;
+
+    /* unfair_flag держит cwnd_loss_phase, хотя очереди нет */
+    if (scc->unfair_flag > 2000 && no_queue)
+        return true;
+
+    /* окно у пола, приложение данные дает, а канал пустой */
+    return no_queue && !rs->is_app_limited &&
+        tcp_snd_cwnd(tp) <= SCC_MIN_SND_CWND << 1;
+}
+
+/*Сторож: если состояние залипло scc_wd_rounds раундов подряд, частично
+    сбрасываем флаги, историю потерь и lt-выборку. Окно, min RTT, bw и режим
+    не трогаем, так что сброс не бывает чаще раза в scc_wd_rounds раундов.*/
+static void spline_watchdog(struct sock *sk, const struct rate_sample *rs)
+{
+    struct tcp_sock *tp = tcp_sk(sk);
+    struct scc *scc = inet_csk_ca(sk);
+
+    if (!scc->round_start)
+        return;
+
+    if (!scc_wedged(sk, rs)) {
+        scc->wd_rounds = 0;
+    } else if (++scc->wd_rounds >= scc_wd_rounds) {
+        scc->wd_rounds = 0;
+        scc->unfair_flag = 0;
+        scc->stable_flag = 0;
+        scc->high_round = 0;
+        scc->loss_cnt = 0;
+        scc_reset_lt_bw_sampling(sk);
+        scc_summary_wd_reset(sk);
+    }
+    scc->wd_lost = tp->lost;
+}
+
 static void update_last_acked_sacked(struct sock *sk, const struct rate_sample *rs)
 {
     struct tcp_sock *tp = tcp_sk(sk);
@@ -804,65 +1360,1245 @@ static void update_last_acked_sacked(struct sock *sk, const struct rate_sample *
     }
 }
 
-static void spline_update(struct sock *sk,
-    const struct rate_sample *rs)
+/* Общее узкое место (shared bottleneck detection, RFC 8382). Потоки хоста с
+    одним узким местом видят одни и те же колебания очереди, поэтому у них
+    совпадают статистики задержки за интервалы T: асимметрия (skew_est),
+    разброс (var_est, MAD), частота значимых колебаний (freq_est) и доля
+    потерь. Вместо OWD получателя берем RTT из rate_sample, вместо сумм по N
+    интервалам - EWMA: 1/32 для skew/var (M = 30) и 1/64 для mean/freq/loss
+    (N = 50). Статистики лежат в scc_flow потока. Поток, у которого SBD
+    впервые нашел узкое место, входит в список своей сети. Раз в T работа
+    сети в workqueue делит потоки списка, которые сейчас в узком месте, на
+    группы, номер группы (scc_sbd_group) общий у потоков с общим узким
+    местом. За проход в группы попадают не больше SCC_SBD_MAX_FLOWS потоков,
+    остальные до следующего прохода в группе 0; /proc/net/spline_sbd
+    показывает список своей сети. */
+#define SCC_SBD_T_US        350000      /* базовый интервал T */
+#define SCC_SBD_MAX_FLOWS   1024        /* потоков в одной группировке */
+#define SCC_SBD_MIN_INTVL   10          /* интервалов до первого решения */
+#define SCC_SBD_MIN_SAMPLES 8           /* RTT в интервале, иначе пропуск */
+
+static const s32 scc_sbd_c_s = -655;    /* -0.01: порог skew_est, Q16 */
+static const s32 scc_sbd_c_h = 19661;   /* 0.3: гистерезис skew_est, Q16 */
+static const u32 scc_sbd_p_v = 179;     /* 0.7: значимое колебание, Q8 var_est */
+static const u32 scc_sbd_p_f = 6554;    /* 0.1: шаг freq_est между группами, Q16 */
+static const u32 scc_sbd_p_mad = 26;    /* 0.1: шаг var_est, Q8 от var_est */
+static const s32 scc_sbd_p_s = 9830;    /* 0.15: шаг skew_est, Q16 */
+static const u32 scc_sbd_p_l = 6554;    /* 0.1: потери, при которых делим по ним */
+static const u32 scc_sbd_p_d = 26;      /* 0.1: шаг pkt_loss, Q8 от pkt_loss */
+
+struct scc_sbd_flow {
+    u64 rtt_sum;            /* сумма RTT за интервал, мкс */
+    u64 dev_sum;            /* сумма |RTT - mean_rtt| за интервал */
+    u32 start_us;           /* начало интервала, tcp_mstamp */
+    u32 n;                  /* выборок RTT за интервал */
+    s32 skew_cnt;           /* (RTT < mean_rtt) - (RTT > mean_rtt) */
+    u32 lost;               /* tp->lost в начале интервала */
+    u32 delivered;          /* tp->delivered в начале интервала */
+    u32 mean_rtt;           /* EWMA средних RTT интервалов, мкс */
+    s32 skew_est;           /* Q16, [-1, 1] */
+    u32 var_est;            /* мкс */
+    u32 freq_est;           /* значимых колебаний за интервал, Q16 */
+    u32 pkt_loss;           /* Q16 */
+    u16 intervals;          /* завершенных интервалов, до U16_MAX */
+    u16 group;              /* 0 - не в узком месте или еще не известно */
+    s8 side;                /* сторона mean_rtt при последнем колебании */
+    u8 bottleneck;
+};
+
+/* Итоги соединения для spline_conn_end_hook */
+struct scc_summary {
+    u64 start_us;           /* tcp_mstamp в spline_init */
+    u64 mode_us[4];         /* время в каждом режиме */
+    u64 last_us;            /* tcp_mstamp прошлого ACK */
+    u32 bw_max;             /* Q24 пакетов/мкс */
+    u32 bw_median;          /* потоковая оценка медианы bw по раундам, Q24 */
+    u32 qdelay_p90;         /* потоковая оценка p90 RTT - min RTT, мкс */
+    u16 lt_policer;         /* сколько раз включался lt_use_bw */
+    u16 min_rtt_drains;     /* DRAIN ради истекшего min RTT */
+    u16 backoffs;           /* сколько раз сработал loss_backoff_cwnd */
+    u16 wd_resets;          /* сколько раз сторож сбросил состояние */
+};
+
+/* Проба bw app-limited потока, см. scc_app_probe */
+struct scc_app_probe {
+    u64 sent;               /* tp->bytes_sent на прошлом ACK пробы */
+    u32 full_us;            /* последняя не app-limited выборка bw */
+    u32 period_us;          /* начало периода бюджета */
+    u32 spent;              /* байт отправлено в пробе за период */
+    u8 active;
+};
+
+/* Детектор неуступчивого чужого трафика, см. scc_unresp_update */
+struct scc_unresp {
+    u32 z;                  /* EWMA темпа чужого трафика, Q24 пакетов/мкс */
+    s32 cov;                /* EWMA du прошлого раунда * dz, Q16 */
+    s16 du;                 /* изменение своего темпа в прошлом раунде, Q8 */
+    u8 rounds;              /* раундов подряд против текущего решения */
+    u8 cycle;               /* раунд в цикле пробы */
+    u8 on;
+};
+
+/* Гарантированный минимум темпа, см. scc_min_rate_update */
+struct scc_min_rate {
+    u32 rate;               /* байт/с, 0 - гарантии сейчас нет */
+    u32 lost;               /* tp->lost на прошлой границе раунда */
+    u32 delivered;          /* tp->delivered на прошлой границе раунда */
+    u16 loss;               /* EWMA доли потерь за раунд, Q8 */
+};
+
+/* Глубина буфера узкого места, см. scc_buf_update */
+struct scc_buf {
+    u32 lost;               /* tp->lost на прошлой границе раунда */
+    u32 rtt_max;            /* max RTT за раунд, мкс */
+    u16 depth;              /* буфер / BDP, Q8 */
+    u8 onsets;              /* начал потерь, до U8_MAX */
+    u8 lossy;               /* в прошлом раунде были потери */
+    u8 cls;                 /* enum spline_buf_class */
+};
+
+/* Связка сокетов прокси, см. scc_link_update */
+struct scc_link {
+    struct scc_flow __rcu *peer;    /* источник, NULL - связки нет */
+    u64 peer_cookie;        /* cookie источника */
+    u32 rate;               /* как источник: bw в байт/с на границе раунда */
+    u32 cap;                /* потолок темпа, байт/с, 0 - нет */
+    atomic_t followers;     /* ведомых у этого сокета, > 0 - он источник */
+    u8 starved;             /* как источник: был app-limited на границе раунда */
+};
+
+/* Эпизод потерь и случайные потери, см. scc_loss_update */
+struct scc_loss {
+    u32 random;             /* всего потерь, признанных случайными */
+    u32 run;                /* потерь в текущем эпизоде, еще без решения */
+    u16 qmax;               /* max очереди при потере в эпизоде, Q8 min RTT */
+    u8 sat;                 /* при потере ACK шли реже, чем пакеты уходили */
+};
+
+/* Состояние потока, которое не влезло в struct scc. Память берется в
+    spline_init и отдается в spline_release, указатель лежит в scc->flow; если
+    памяти не нашлось, он NULL и поток живет без этих функций, как tcp_cdg
+    без gradients. В список сети scc_net.flows поток входит, только когда он
+    ей понадобился: SBD нашел у него узкое место или его связали
+    (scc_link). Список читают группировка SBD и /proc, поэтому входить в
+    него и выходить из него можно только под scc_net.lock; поток вне списка
+    эту блокировку не берет ни при открытии, ни при закрытии. Ведомый связки
+    держит ссылку на scc_flow источника, и память отдается через RCU, когда
+    ссылок не осталось. */
+struct scc_flow {
+    struct list_head node;  /* в scc_net.flows */
+    const struct sock *sk;  /* владелец, NULL - сокет закрыт */
+    refcount_t ref;
+    struct rcu_head rcu;
+    u16 id;                 /* номер потока в сети, 0 - не в списке */
+    u8 listed;              /* в scc_net.flows */
+    struct scc_sbd_flow sbd;
+    struct scc_summary sum;
+    struct scc_app_probe ap;
+    struct scc_unresp unresp;
+    struct scc_min_rate mr;
+    struct scc_buf buf;
+    struct scc_loss loss;
+    struct scc_link link;
+};
+
+/* Потоки одной сети (network namespace) */
+struct scc_net {
+    spinlock_t lock;
+    struct list_head flows;
+    u32 sbd_grouped_us;
+    u16 next_id;
+    struct work_struct sbd_work;    /* scc_sbd_regroup */
+    struct scc_rtt_sync rtt_syncs[SCC_RTT_SYNC];
+};
+
+static unsigned int scc_net_id __read_mostly;
+
+static struct scc_net *scc_net(const struct net *net)
 {
-    struct scc *scc = inet_csk_ca(sk);
-    update_min_rtt(sk, rs);
-    update_last_acked_sacked(sk, rs);
-    if (scc_is_next_cycle_phase(sk, rs) || 
-        scc->start_phase) 
-        update_bandwidth(sk);
-    scc_update_bw(sk, rs);
-    fairness_check(sk);
-    high_rtt_round(sk);
-    stable_check(sk);
-    loss_rate(sk);
-    update_probes(sk, rs);
+    return net_generic(net, scc_net_id);
 }
 
-/*На данном этапе, идет выборка между двумя cwnd или их общая сглаженная. cwnd_spline(cwnd) и 
-    target_cwnd(scc_bdp и BBR подобных вычислений).
-    Какой из этих cwnd более предпочителен для текущей состоянии сети?*/
-static u32 next_cwnd(struct sock *sk, const struct rate_sample *rs,
- u32 target_cwnd, u32 cwnd)
+static struct scc_rtt_sync *scc_rtt_syncs(struct sock *sk)
 {
-    struct scc *scc = inet_csk_ca(sk);
-    u64 tf = percent_gain(scc->lt_last_lost, scc->stable_flag, scc->unfair_flag);
-    if(tf < thresh_tf && !scc->start_phase &&
-        scc->loss_cnt > 50){
-        return cwnd;
-    }
-    else if(((scc->unfair_flag > 2000 && scc->stable_flag < 300) ||
-        scc->unfair_flag > scc->stable_flag + 500) && scc->loss_cnt > 5) {
-        return ((target_cwnd + cwnd) * 7) >> 4;
-    } else {
-        return max(target_cwnd, cwnd);
-    }
+    return scc_net(sock_net(sk))->rtt_syncs;
 }
 
-static void spline_cwnd_send(struct sock *sk, const struct rate_sample *rs, u32 bw)
+static struct scc_flow *scc_flow(struct sock *sk)
 {
     struct scc *scc = inet_csk_ca(sk);
-    struct tcp_sock *tp = tcp_sk(sk);
-    u64 tf = percent_gain(scc->lt_last_lost, scc->stable_flag, scc->unfair_flag);
-    u32 cwnd_segments, target_cwnd, max_cwnd;
-    target_cwnd = scc_bdp(sk, bw, scc->cwnd_gain);
-    cwnd_segments = next_cwnd(sk, rs, target_cwnd, scc->curr_cwnd);
-    cwnd_segments = max(cwnd_segments, SCC_MIN_SND_CWND);
-    cwnd_segments += rs->acked_sacked;
-    tcp_snd_cwnd_set(tp, min(cwnd_segments, tp->snd_cwnd_clamp));
+
+    return scc->flow;
 }
 
-static void spline_main(struct sock *sk, const struct rate_sample *rs)
+static void scc_flow_alloc(struct sock *sk)
 {
-    struct tcp_sock *tp = tcp_sk(sk);
     struct scc *scc = inet_csk_ca(sk);
-    u32 bw;
-    scc->curr_cwnd = tcp_snd_cwnd(tp);
-    spline_update(sk, rs);
-    bw = scc_bw(sk);
-    bbr_set_pacing_rate(sk, bw, scc->pacing_gain);
+    struct tcp_sock *tp = tcp_sk(sk);
+    struct scc_flow *f;
+
+    f = kzalloc(sizeof(*f), GFP_NOWAIT | __GFP_NOWARN);
+    scc->flow = f;
+    if (!f)
+        return;
+    f->sk = sk;
+    refcount_set(&f->ref, 1);
+    f->sbd.start_us = tp->tcp_mstamp;
+    f->sbd.lost = tp->lost;
+    f->sbd.delivered = tp->delivered;
+    f->sum.start_us = tp->tcp_mstamp;
+    f->sum.last_us = tp->tcp_mstamp;
+    f->ap.full_us = tp->tcp_mstamp;
+    f->ap.period_us = tp->tcp_mstamp;
+    f->mr.lost = tp->lost;
+    f->mr.delivered = tp->delivered;
+    f->buf.lost = tp->lost;
+}
+
+/* Поток понадобился сети, см. struct scc_flow. Вызывается в контексте
+    сокета, поэтому listed меняется без гонок. */
+static void scc_flow_list(struct sock *sk)
+{
+    struct scc_net *sn = scc_net(sock_net(sk));
+    struct scc_flow *f = scc_flow(sk);
+
+    if (!f || f->listed)
+        return;
+    spin_lock_bh(&sn->lock);
+    if (!++sn->next_id)
+        sn->next_id = 1;
+    f->id = sn->next_id;
+    list_add_tail(&f->node, &sn->flows);
+    spin_unlock_bh(&sn->lock);
+    f->listed = 1;
+}
+
+static void scc_flow_put(struct scc_flow *f)
+{
+    if (f && refcount_dec_and_test(&f->ref))
+        kfree_rcu(f, rcu);
+}
+
+/* Ведомый отпускает источник; без ведомых источник перестает им быть */
+static void scc_link_unfollow(struct scc_flow *p)
+{
+    if (!p)
+        return;
+    atomic_dec(&p->link.followers);
+    scc_flow_put(p);
+}
+
+static void scc_flow_free(struct sock *sk)
+{
+    struct scc_net *sn = scc_net(sock_net(sk));
+    struct scc *scc = inet_csk_ca(sk);
+    struct scc_flow *f = scc->flow, *peer;
+
+    if (!f)
+        return;
+    if (f->listed) {
+        spin_lock_bh(&sn->lock);
+        list_del(&f->node);
+        spin_unlock_bh(&sn->lock);
+    }
+    WRITE_ONCE(f->sk, NULL);
+    peer = rcu_replace_pointer(f->link.peer, NULL, lockdep_sock_is_held(sk));
+    scc_link_unfollow(peer);
+    scc_flow_put(f);
+    scc->flow = NULL;
+}
+
+/* Группа узкого места потока, 0 - нет или еще не известна */
+static u16 scc_sbd_group(struct sock *sk)
+{
+    struct scc_flow *f = scc_flow(sk);
+
+    return f ? READ_ONCE(f->sbd.group) : 0;
+}
+
+static int scc_sbd_cmp_freq(const void *a, const void *b)
+{
+    u32 x = (*(struct scc_flow * const *)a)->sbd.freq_est,
+        y = (*(struct scc_flow * const *)b)->sbd.freq_est;
+
+    return x < y ? -1 : x > y;
+}
+
+static int scc_sbd_cmp_var(const void *a, const void *b)
+{
+    u32 x = (*(struct scc_flow * const *)a)->sbd.var_est,
+        y = (*(struct scc_flow * const *)b)->sbd.var_est;
+
+    return x < y ? -1 : x > y;
+}
+
+static int scc_sbd_cmp_skew(const void *a, const void *b)
+{
+    s32 x = (*(struct scc_flow * const *)a)->sbd.skew_est,
+        y = (*(struct scc_flow * const *)b)->sbd.skew_est;
+
+    return x < y ? -1 : x > y;
+}
+
+static int scc_sbd_cmp_loss(const void *a, const void *b)
+{
+    u32 x = (*(struct scc_flow * const *)a)->sbd.pkt_loss,
+        y = (*(struct scc_flow * const *)b)->sbd.pkt_loss;
+
+    return x < y ? -1 : x > y;
+}
+
+static const cmp_func_t scc_sbd_cmp[] = {
+    scc_sbd_cmp_freq, scc_sbd_cmp_var, scc_sbd_cmp_skew, scc_sbd_cmp_loss,
+};
+
+/* Соседи после сортировки по признаку stage слишком далеки для одной группы */
+static bool scc_sbd_apart(int stage, const struct scc_sbd_flow *a,
+    const struct scc_sbd_flow *b)
+{
+    switch (stage) {
+    case 0:
+        return b->freq_est - a->freq_est > scc_sbd_p_f;
+    case 1:
+        return (u64)(b->var_est - a->var_est) << BBR_SCALE >
+            (u64)scc_sbd_p_mad * b->var_est;
+    case 2:
+        return b->skew_est - a->skew_est > scc_sbd_p_s;
+    default:
+        return b->pkt_loss > scc_sbd_p_l &&
+            (u64)(b->pkt_loss - a->pkt_loss) << BBR_SCALE >
+            (u64)scc_sbd_p_d * b->pkt_loss;
+    }
+}
+
+/* Деление RFC 8382 по очереди: freq_est, var_est, skew_est, pkt_loss. Номер
+    группы - наименьший id потока в ней, так что он не скачет между
+    проходами. */
+static void scc_sbd_split(struct scc_flow **idx, int lo, int hi, int stage)
+{
+    int i, start = lo;
+    u16 group = U16_MAX;
+
+    if (stage == ARRAY_SIZE(scc_sbd_cmp)) {
+        for (i = lo; i < hi; i++)
+            group = min(group, idx[i]->id);
+        for (i = lo; i < hi; i++)
+            WRITE_ONCE(idx[i]->sbd.group, group);
+        return;
+    }
+    sort(&idx[lo], hi - lo, sizeof(*idx), scc_sbd_cmp[stage], NULL);
+    for (i = lo + 1; i <= hi; i++) {
+        if (i < hi && !scc_sbd_apart(stage, &idx[i - 1]->sbd, &idx[i]->sbd))
+            continue;
+        scc_sbd_split(idx, start, i, stage + 1);
+        start = i;
+    }
+}
+
+/* Раз в T, в workqueue: потоки списка в узком месте делятся на группы,
+    остальные - группа 0. Статистики чужих потоков читаются без их сокетов,
+    рассинхрон в один интервал группировке не мешает. Сортировка ограничена
+    SCC_SBD_MAX_FLOWS потоками, чтобы scc_net.lock не держался долго. */
+static void scc_sbd_regroup(struct work_struct *work)
+{
+    struct scc_net *sn = container_of(work, struct scc_net, sbd_work);
+    struct scc_flow *f, **idx;
+    int n = 0;
+
+    idx = kmalloc_array(SCC_SBD_MAX_FLOWS, sizeof(*idx), GFP_KERNEL);
+    if (!idx)
+        return;
+    spin_lock_bh(&sn->lock);
+    list_for_each_entry(f, &sn->flows, node) {
+        if (n < SCC_SBD_MAX_FLOWS && READ_ONCE(f->sbd.bottleneck))
+            idx[n++] = f;
+        else
+            WRITE_ONCE(f->sbd.group, 0);
+    }
+    scc_sbd_split(idx, 0, n, 0);
+    spin_unlock_bh(&sn->lock);
+    kfree(idx);
+}
+
+/* Первый поток списка, закрывший интервал T после прошлой группировки,
+    ставит ее в очередь */
+static void scc_sbd_kick(struct scc_net *sn, u32 now)
+{
+    u32 last = READ_ONCE(sn->sbd_grouped_us);
+
+    if (now - last >= SCC_SBD_T_US &&
+        cmpxchg(&sn->sbd_grouped_us, last, now) == last)
+        schedule_work(&sn->sbd_work);
+}
+
+/* Конец интервала T: mean/skew/var/freq/loss и решение, в узком ли месте
+    поток: skew_est < c_s, или < c_h, если был там, или потери выше p_l. */
+static void scc_sbd_interval(struct scc_sbd_flow *f, struct tcp_sock *tp)
+{
+    u32 mean = div_u64(f->rtt_sum, f->n), band;
+    u32 lost = tp->lost - f->lost, delivered = tp->delivered - f->delivered;
+    s8 side = 0;
+
+    if (!f->mean_rtt) {
+        f->mean_rtt = mean;
+        return;
+    }
+    f->skew_est += (s32)(div64_long((s64)f->skew_cnt * 65536, f->n) -
+        f->skew_est) >> 5;
+    f->var_est = f->var_est - (f->var_est >> 5) +
+        ((u32)div_u64(f->dev_sum, f->n) >> 5);
+    band = (u64)f->var_est * scc_sbd_p_v >> BBR_SCALE;
+    if (mean > f->mean_rtt + band)
+        side = 1;
+    else if (mean + band < f->mean_rtt)
+        side = -1;
+    f->freq_est -= f->freq_est >> 6;
+    if (side && f->side && side != f->side)
+        f->freq_est += (1 << 16) >> 6;
+    if (side)
+        f->side = side;
+    f->mean_rtt = f->mean_rtt - (f->mean_rtt >> 6) + (mean >> 6);
+    f->pkt_loss -= f->pkt_loss >> 6;
+    if (lost + delivered)
+        f->pkt_loss += div_u64((u64)lost << 16, lost + delivered) >> 6;
+    if (f->intervals < U16_MAX)
+        f->intervals++;
+
+    f->bottleneck = f->intervals >= SCC_SBD_MIN_INTVL &&
+        (f->skew_est < scc_sbd_c_s ||
+         (f->bottleneck && f->skew_est < scc_sbd_c_h) ||
+         f->pkt_loss > scc_sbd_p_l);
+}
+
+static void scc_sbd_update(struct sock *sk, const struct rate_sample *rs)
+{
+    struct scc_flow *slot = scc_flow(sk);
+    struct tcp_sock *tp = tcp_sk(sk);
+    struct scc_sbd_flow *f;
+    u32 now = tp->tcp_mstamp, rtt;
+
+    if (!slot)
+        return;
+    f = &slot->sbd;
+    if (rs->rtt_us > 0) {
+        rtt = rs->rtt_us;
+        f->rtt_sum += rtt;
+        f->n++;
+        if (f->mean_rtt) {
+            f->skew_cnt += (rtt < f->mean_rtt) - (rtt > f->mean_rtt);
+            f->dev_sum += rtt > f->mean_rtt ? rtt - f->mean_rtt :
+                f->mean_rtt - rtt;
+        }
+    }
+    if (now - f->start_us < SCC_SBD_T_US)
+        return;
+    if (f->n >= SCC_SBD_MIN_SAMPLES)
+        scc_sbd_interval(f, tp);
+    if (f->bottleneck)
+        scc_flow_list(sk);
+    f->start_us = now;
+    f->rtt_sum = 0;
+    f->dev_sum = 0;
+    f->n = 0;
+    f->skew_cnt = 0;
+    f->lost = tp->lost;
+    f->delivered = tp->delivered;
+    if (slot->listed)
+        scc_sbd_kick(scc_net(sock_net(sk)), now);
+}
+
+/* Только список сети, из которой читают: потоки, у которых SBD находил
+    узкое место, и связанные */
+static int scc_sbd_show(struct seq_file *seq, void *v)
+{
+    struct scc_net *sn = scc_net(seq_file_single_net(seq));
+    const struct scc_sbd_flow *f;
+    const struct scc_flow *flow;
+    const struct sock *sk;
+
+    seq_puts(seq, "id group bottleneck intervals mean_rtt_us var_est_us "
+        "skew_est freq_est pkt_loss local remote\n");
+    spin_lock_bh(&sn->lock);
+    list_for_each_entry(flow, &sn->flows, node) {
+        f = &flow->sbd;
+        sk = flow->sk;
+        seq_printf(seq, "%u %u %u %u %u %u %d %u %u ", flow->id, f->group,
+            f->bottleneck, f->intervals, f->mean_rtt, f->var_est,
+            f->skew_est, f->freq_est, f->pkt_loss);
+        if (sk->sk_family == AF_INET6)
+            seq_printf(seq, "[%pI6c]:%u [%pI6c]:%u\n",
+                &sk->__sk_common.skc_v6_rcv_saddr, sk->__sk_common.skc_num,
+                &sk->__sk_common.skc_v6_daddr,
+                ntohs(sk->__sk_common.skc_dport));
+        else
+            seq_printf(seq, "%pI4:%u %pI4:%u\n",
+                &sk->__sk_common.skc_rcv_saddr, sk->__sk_common.skc_num,
+                &sk->__sk_common.skc_daddr, ntohs(sk->__sk_common.skc_dport));
+    }
+    spin_unlock_bh(&sn->lock);
+    return 0;
+}
+
+/* Потоковая оценка квантиля q (Q8): шаг вверх q, вниз 1 - q от est/16, так
+    что est стоит там, где выше него доля выборок 1 - q. */
+static void scc_quantile(u32 *est, u32 x, u32 q)
+{
+    u32 step = max(*est >> 4, 1U);
+
+    if (!*est)
+        *est = x;
+    else if (x > *est)
+        *est += max(step * q >> BBR_SCALE, 1U);
+    else if (x < *est)
+        *est -= min(max(step * (BBR_UNIT - q) >> BBR_SCALE, 1U), *est);
+}
+
+static void scc_summary_lt_policer(struct sock *sk)
+{
+    struct scc_flow *f = scc_flow(sk);
+
+    if (f && f->sum.lt_policer < U16_MAX)
+        f->sum.lt_policer++;
+}
+
+static void scc_summary_min_rtt_drain(struct sock *sk)
+{
+    struct scc_flow *f = scc_flow(sk);
+
+    if (f && f->sum.min_rtt_drains < U16_MAX)
+        f->sum.min_rtt_drains++;
+}
+
+static void scc_summary_backoff(struct sock *sk)
+{
+    struct scc_flow *f = scc_flow(sk);
+
+    if (f && f->sum.backoffs < U16_MAX)
+        f->sum.backoffs++;
+}
+
+static void scc_summary_wd_reset(struct sock *sk)
+{
+    struct scc_flow *f = scc_flow(sk);
+
+    if (f && f->sum.wd_resets < U16_MAX)
+        f->sum.wd_resets++;
+}
+
+/* Время в режимах считается до update_probes: промежуток с прошлого ACK
+    прошел в режиме, выбранном на прошлом ACK. bw - раз в раунд, очередь -
+    на каждый ACK с RTT. */
+static void scc_summary_update(struct sock *sk, const struct rate_sample *rs)
+{
+    struct scc_flow *f = scc_flow(sk);
+    struct scc *scc = inet_csk_ca(sk);
+    struct tcp_sock *tp = tcp_sk(sk);
+    u64 now = tp->tcp_mstamp;
+    u32 bw;
+
+    if (!f)
+        return;
+    f->sum.mode_us[scc->current_mode] += now - f->sum.last_us;
+    f->sum.last_us = now;
+    if (scc->round_start) {
+        bw = scc_bw(sk);
+        f->sum.bw_max = max(f->sum.bw_max, bw);
+        scc_quantile(&f->sum.bw_median, bw, BBR_UNIT >> 1);
+    }
+    if (rs->rtt_us > 0 && scc->last_min_rtt)
+        scc_quantile(&f->sum.qdelay_p90,
+            max_t(s64, rs->rtt_us - (s64)scc->last_min_rtt, 0), 230);
+}
+
+static u64 scc_summary_rate(struct sock *sk, u32 bw)
+{
+    return (u64)bw * tcp_sk(sk)->mss_cache * USEC_PER_SEC >> BW_SCALE_2;
+}
+
+static void scc_summary_emit(struct sock *sk)
+{
+    struct spline_conn_summary sum = {};
+    struct scc_flow *f = scc_flow(sk);
+    struct scc *scc = inet_csk_ca(sk);
+    struct tcp_sock *tp = tcp_sk(sk);
+    u64 now = tcp_clock_us();
+    int i;
+
+    sum.bytes_acked = tp->bytes_acked;
+    sum.bytes_sent = tp->bytes_sent;
+    sum.min_rtt_us = scc->last_min_rtt;
+    sum.retrans = tp->total_retrans;
+    if (f) {
+        sum.has_flow = 1;
+        sum.loss_backoffs = f->sum.backoffs;
+        sum.wd_resets = f->sum.wd_resets;
+        sum.duration_us = now - f->sum.start_us;
+        /* от последнего ACK до закрытия - в текущем режиме */
+        f->sum.mode_us[scc->current_mode] += now - f->sum.last_us;
+        for (i = 0; i < ARRAY_SIZE(sum.mode_us); i++)
+            sum.mode_us[i] = f->sum.mode_us[i];
+        sum.bw_max = scc_summary_rate(sk, f->sum.bw_max);
+        sum.bw_median = scc_summary_rate(sk, f->sum.bw_median);
+        sum.qdelay_p90_us = f->sum.qdelay_p90;
+        sum.lt_policer = f->sum.lt_policer;
+        sum.min_rtt_drains = f->sum.min_rtt_drains;
+        sum.buf_class = f->buf.cls;
+        sum.random_lost = f->loss.random;
+        sum.buf_bytes = (u64)scc_bdp(sk, scc_bw(sk), BW_UNIT) *
+            tp->mss_cache * f->buf.depth >> BBR_SCALE;
+    }
+    spline_conn_end_hook(sk, &sum);
+}
+
+/* Проба bw для app-limited потоков. Выборки такого потока только
+    поднимают bw, и после долгой болтовни мелкими ответами оценка устаревает:
+    всплеск уходит с темпом, который канал давно не подтверждал. Если полной
+    выборки не было SCC_APP_PROBE_STALE_US, поток в PROBE_BW шлет данные
+    приложения с темпом scc_app_probe_gain от bw, так что пачка приходит в
+    узкое место быстрее, чем оно ее пропускает. Если ACK пачки разошлись
+    шире, чем она ушла, темп ACK задало узкое место, а не приложение, и
+    такая выборка идет в фильтр bw как полная - и вверх, и вниз. Своих
+    пакетов модуль не шлет: повторная отправка уже отправленных данных из
+    congestion control невозможна. Бюджет - scc_app_probe_bytes байт в
+    секунду на поток, отправленных с темпом пробы; 0 выключает пробу. */
+#define SCC_APP_PROBE_STALE_US  500000
+#define SCC_APP_PROBE_PERIOD_US 1000000
+#define SCC_APP_PROBE_TRAIN     4       /* пакетов в выборке, не меньше */
+
+static const int scc_app_probe_gain = BBR_UNIT * 4;
+
+static unsigned int scc_app_probe_bytes;
+module_param(scc_app_probe_bytes, uint, 0644);
+MODULE_PARM_DESC(scc_app_probe_bytes,
+    "Bytes per second an app-limited flow may send at the probe rate (0 = off)");
+
+static bool scc_app_probe_sample(struct sock *sk, const struct rate_sample *rs)
+{
+    struct scc_flow *f = scc_flow(sk);
+
+    return f && f->ap.active && !rs->is_ack_delayed &&
+        rs->delivered >= SCC_APP_PROBE_TRAIN &&
+        rs->rcv_interval_us > rs->snd_interval_us + (rs->snd_interval_us >> 3);
+}
+
+/* gain темпа с учетом пробы. Когда проба кончается, темп опускается сразу:
+    bbr_set_pacing_rate вне DRAIN его только поднимает. */
+static int scc_app_probe(struct sock *sk, const struct rate_sample *rs, int gain)
+{
+    struct scc_flow *f = scc_flow(sk);
+    struct scc *scc = inet_csk_ca(sk);
+    struct tcp_sock *tp = tcp_sk(sk);
+    u32 now = tp->tcp_mstamp;
+    bool active;
+
+    if (!f)
+        return gain;
+    if (!rs->is_app_limited && rs->delivered > 0)
+        f->ap.full_us = now;
+    if (f->ap.active)
+        f->ap.spent += min_t(u64, tp->bytes_sent - f->ap.sent, U32_MAX);
+    f->ap.sent = tp->bytes_sent;
+    if (now - f->ap.period_us >= SCC_APP_PROBE_PERIOD_US) {
+        f->ap.period_us = now;
+        f->ap.spent = 0;
+    }
+
+    active = scc_app_probe_bytes && rs->is_app_limited &&
+        scc->current_mode == MODE_PROBE_BW &&
+        now - f->ap.full_us >= SCC_APP_PROBE_STALE_US &&
+        f->ap.spent < scc_app_probe_bytes;
+    if (!active && f->ap.active)
+        WRITE_ONCE(sk->sk_pacing_rate,
+            bbr_bw_to_pacing_rate(sk, scc_pacing_bw(sk, scc_bw(sk)), gain));
+    f->ap.active = active;
+    return active ? max(gain, scc_app_probe_gain) : gain;
+}
+
+/* Неуступчивый чужой трафик (UDP, QUIC без контроля перегрузки). Рядом
+    с ним loss_cnt и unfair_flag копятся от потерь, которые Spline не
+    вызывал и не уберет: loss_backoff_cwnd и cwnd_loss_phase режут окно до
+    голода, а bbr_high_gain только добавляет потерь. Раз в раунд из той же
+    модели, что и xt_share, берется темп чужого трафика: r = (s + z) / C,
+    емкость C = xt_rate / наклон, z = r * C - s. Отзывчивый поток уступает
+    через раунд после того, как мы прибавили, и z падает вслед за s, поэтому
+    регрессия dz на du прошлого раунда (beta) у него заметно ниже нуля. Если
+    чужие занимают больше половины узкого места, а beta не ниже -1/8, 16
+    раундов подряд, поток считается соседом неуступчивого трафика; решение
+    снимается после 8 раундов без этих условий или когда xt_share (а он без
+    очереди тает) опустится ниже 1/4. Тогда Spline садится на остаток
+    емкости: pacing 1.0 от bw и раз в 8 раундов 5/4 для пробы, окно 2 BDP,
+    без loss_backoff_cwnd и DRAIN по потерям. */
+static void scc_unresp_update(struct sock *sk, u64 s, u64 r, s32 du)
+{
+    struct scc_flow *f = scc_flow(sk);
+    struct scc *scc = inet_csk_ca(sk);
+    struct scc_unresp *u;
+    s32 du_prev, dz, beta;
+    u64 slope, c, z;
+    bool cond;
+
+    if (!f)
+        return;
+    u = &f->unresp;
+    du_prev = u->du;
+    u->du = du;
+    u->cycle = (u->cycle + 1) & 7;
+    if (scc->xt_var < scc_xt_min_var || scc->xt_cov <= 0)
+        return;
+
+    slope = div_u64((u64)scc->xt_cov << BBR_SCALE, scc->xt_var);
+    if (!slope)
+        return;
+    c = div_u64((u64)scc->xt_rate << BBR_SCALE, slope);
+    z = (r * c) >> BBR_SCALE;
+    z = min_t(u64, z > s ? z - s : 0, U32_MAX);
+    if (!u->z) {
+        u->z = max_t(u32, z, 1);
+        return;
+    }
+
+    if (z >= u->z)
+        dz = min_t(u64, div_u64((z - u->z) << BBR_SCALE, u->z), BBR_UNIT);
+    else
+        dz = -(s32)div_u64((u->z - z) << BBR_SCALE, u->z);
+    u->cov += (du_prev * dz - u->cov) / 8;
+    u->z = max_t(u32, u->z - (u->z >> 3) + (u32)(z >> 3), 1);
+
+    beta = (s32)div_s64((s64)u->cov << BBR_SCALE, scc->xt_var);
+    cond = scc->xt_share >= BBR_UNIT / 2 && beta > scc_unresp_beta;
+    if (cond == u->on) {
+        u->rounds = 0;
+    } else if (++u->rounds >= (u->on ? 8 : 16)) {
+        u->on = cond;
+        u->rounds = 0;
+    }
+}
+
+static bool scc_unresp(struct sock *sk)
+{
+    struct scc_flow *f = scc_flow(sk);
+    struct scc *scc = inet_csk_ca(sk);
+
+    return f && f->unresp.on && scc->xt_share >= BBR_UNIT / 4;
+}
+
+static int scc_unresp_gain(struct sock *sk)
+{
+    struct scc_flow *f = scc_flow(sk);
+
+    return f && !f->unresp.cycle ? scc_unresp_probe_gain : BBR_UNIT;
+}
+
+/* Минимальный темп для приоритетных сокетов (управление, heartbeat).
+    loss_backoff_cwnd за шаг режет окно до 42%, а пол SCC_MIN_SND_CWND в
+    сегментах по темпу ничего не значит: на длинном RTT он дает струйку, на
+    коротком - лишнее. Сокет с SO_PRIORITY не ниже scc_min_rate_prio получает
+    scc_min_rate_bytes байт/с, spline_min_rate_hook может задать свой минимум
+    для любого сокета. Ниже него не опускаются ни pacing, ни cwnd (темп на
+    текущий RTT), пока доля потерь за раунд (EWMA 1/4) ниже
+    scc_min_rate_max_loss: дальше минимум сам стал бы перегрузкой, и поток
+    живет по обычным правилам. Минимум и потери пересчитываются раз в раунд
+    и лежат в scc_flow. */
+static const u32 scc_min_rate_max_loss = BBR_UNIT / 8;
+
+static unsigned int scc_min_rate_bytes;
+module_param(scc_min_rate_bytes, uint, 0644);
+MODULE_PARM_DESC(scc_min_rate_bytes,
+    "Minimum rate in bytes/s for sockets with SO_PRIORITY >= scc_min_rate_prio (0 = off)");
+
+static unsigned int scc_min_rate_prio = TC_PRIO_CONTROL;
+module_param(scc_min_rate_prio, uint, 0644);
+MODULE_PARM_DESC(scc_min_rate_prio, "Lowest SO_PRIORITY that gets scc_min_rate_bytes");
+
+static void scc_min_rate_update(struct sock *sk)
+{
+    struct scc_flow *f = scc_flow(sk);
+    struct scc *scc = inet_csk_ca(sk);
+    struct tcp_sock *tp = tcp_sk(sk);
+    u32 lost, delivered, rate = 0;
+    int override;
+
+    if (!f || !scc->round_start)
+        return;
+
+    lost = tp->lost - f->mr.lost;
+    delivered = tp->delivered - f->mr.delivered;
+    f->mr.lost = tp->lost;
+    f->mr.delivered = tp->delivered;
+    if (lost + delivered) {
+        u32 frac = div_u64((u64)lost << BBR_SCALE, lost + delivered);
+
+        f->mr.loss = f->mr.loss + ((s32)frac - f->mr.loss) / 4;
+    }
+
+    if (scc_min_rate_bytes && READ_ONCE(sk->sk_priority) >= scc_min_rate_prio)
+        rate = scc_min_rate_bytes;
+    override = spline_min_rate_hook(sk, rate);
+    if (override > 0)
+        rate = override;
+    f->mr.rate = f->mr.loss < scc_min_rate_max_loss ? rate : 0;
+}
+
+static u32 scc_min_rate(struct sock *sk)
+{
+    struct scc_flow *f = scc_flow(sk);
+
+    return f ? f->mr.rate : 0;
+}
+
+/* Окно, которое держит scc_min_rate на текущем RTT */
+static u32 scc_min_rate_cwnd(struct sock *sk)
+{
+    struct scc *scc = inet_csk_ca(sk);
+    u32 rate = scc_min_rate(sk), mss = tcp_sk(sk)->mss_cache;
+    u64 bytes;
+
+    if (!rate || !mss)
+        return 0;
+    bytes = (u64)rate * max(scc->curr_rtt, scc->last_min_rtt);
+    return min_t(u64, DIV_ROUND_UP_ULL(bytes, (u64)mss * USEC_PER_SEC), U32_MAX);
+}
+
+/* Связка сокетов split-TCP прокси. Прокси принимает данные на одном сокете
+    и отдает их клиенту через другой; когда клиентский поток медленный, сторона,
+    которая наполняет прокси, все равно шлет на полной скорости, и разница
+    копится в буферах прокси. Spline может ограничить только то, что сам
+    отправляет с этого хоста, поэтому связка ставит потолок темпа одного
+    сокета (ведомого) по bw другого (источника). Пока источник app-limited,
+    то есть буфер прокси пуст, ведомый шлет до bw * scc_link_gain: запас
+    нужен, чтобы источник мог показать больший bw (app-limited выборки его
+    оценку только поднимают). Пока у источника есть очередь, потолок
+    bw * scc_link_drain_gain, и очередь уходит. Ровно 1.0 копил бы в прокси
+    любую ошибку оценки, а постоянный запас - 1/4 темпа. Так связывается,
+    например, отправка локального бэкенда в прокси с отправкой прокси
+    клиенту, если они на одном хосте.
+
+    Связку задает запись "ВЕДОМЫЙ ИСТОЧНИК" в /proc/net/spline_link, где оба -
+    cookie сокетов (getsockopt SO_COOKIE); "ВЕДОМЫЙ 0" снимает ее. Файл свой
+    в каждом netns, 0600, и сокеты ищутся только в netns пишущего процесса;
+    запись через /proc/PID/net чужого netns отклоняется. Кроме того, нужен
+    CAP_NET_ADMIN в user namespace этого netns или владение обоими
+    сокетами. Источник раз в раунд кладет в свой scc_flow bw в байт/с,
+    ведомый раз в раунд берет его оттуда по ссылке на этот scc_flow. Пока у
+    источника нет оценки или он закрыт, потолка нет. Оба сокета - Spline; у
+    источника можно несколько ведомых, и он перестает публиковать bw, когда
+    последний из них отвязан или закрыт. */
+static const u32 scc_link_gain = BBR_UNIT * 5 / 4;
+static const u32 scc_link_drain_gain = BBR_UNIT * 15 / 16;
+
+static void scc_link_update(struct sock *sk)
+{
+    struct scc_flow *f = scc_flow(sk), *p;
+    struct scc *scc = inet_csk_ca(sk);
+    u32 rate = 0, gain = 0;
+
+    if (!f || !scc->round_start)
+        return;
+
+    if (atomic_read(&f->link.followers)) {
+        WRITE_ONCE(f->link.rate, min_t(u64, U32_MAX,
+            scc_rate_bytes_per_sec(sk, scc_bw(sk), BBR_UNIT)));
+        WRITE_ONCE(f->link.starved, !!tcp_sk(sk)->app_limited);
+    }
+
+    rcu_read_lock();
+    p = rcu_dereference(f->link.peer);
+    if (p && READ_ONCE(p->sk)) {
+        rate = READ_ONCE(p->link.rate);
+        gain = READ_ONCE(p->link.starved) ? scc_link_gain : scc_link_drain_gain;
+    }
+    rcu_read_unlock();
+    f->link.cap = min_t(u64, U32_MAX, ((u64)rate * gain) >> BBR_SCALE);
+}
+
+static u32 scc_link_cap(struct sock *sk)
+{
+    struct scc_flow *f = scc_flow(sk);
+
+    return f ? f->link.cap : 0;
+}
+
+/* права проверяются до блокировок: ns_capable() может писать в аудит */
+static bool scc_link_allowed(const struct sock *sk, bool admin, kuid_t euid)
+{
+    return admin || uid_eq(sock_i_uid(sk), euid);
+}
+
+/* Сокет сети с данным cookie, со ссылкой. Индекса по cookie в ядре нет, и
+    не все потоки лежат в scc_net.flows, поэтому это проход по ehash сети:
+    связка ставится редко и из process context, а корзины берутся каждая под
+    своей блокировкой. */
+static struct sock *scc_link_lookup(struct net *net, u64 cookie)
+{
+    struct inet_hashinfo *h = net->ipv4.tcp_death_row.hashinfo;
+    struct hlist_nulls_node *node;
+    struct sock *sk;
+    unsigned int i;
+
+    for (i = 0; i <= h->ehash_mask; i++) {
+        if (hlist_nulls_empty(&h->ehash[i].chain))
+            continue;
+        spin_lock_bh(inet_ehash_lockp(h, i));
+        sk_nulls_for_each(sk, node, &h->ehash[i].chain) {
+            if (sk_fullsock(sk) && net_eq(sock_net(sk), net) &&
+                atomic64_read(&sk->sk_cookie) == cookie) {
+                sock_hold(sk);
+                spin_unlock_bh(inet_ehash_lockp(h, i));
+                return sk;
+            }
+        }
+        spin_unlock_bh(inet_ehash_lockp(h, i));
+        cond_resched();
+    }
+    return NULL;
+}
+
+/* scc_flow сокета, если это поток Spline; под lock_sock */
+static struct scc_flow *scc_link_flow(struct sock *sk)
+{
+    if (inet_csk(sk)->icsk_ca_ops->owner != THIS_MODULE)
+        return NULL;
+    return scc_flow(sk);
+}
+
+static int scc_link(struct net *net, u64 cookie, u64 src)
+{
+    bool admin = ns_capable(net->user_ns, CAP_NET_ADMIN);
+    kuid_t euid = current_euid();
+    struct sock *usk, *dsk = NULL;
+    struct scc_flow *u, *d = NULL, *old = NULL;
+    int ret = -EPERM;
+
+    usk = scc_link_lookup(net, cookie);
+    if (!usk)
+        return -ENOENT;
+    if (src) {
+        dsk = scc_link_lookup(net, src);
+        if (!dsk) {
+            ret = -ENOENT;
+            goto out;
+        }
+    }
+    if (!scc_link_allowed(usk, admin, euid) ||
+        (dsk && !scc_link_allowed(dsk, admin, euid)))
+        goto out;
+
+    ret = -ENOENT;
+    if (dsk) {
+        lock_sock(dsk);
+        d = scc_link_flow(dsk);
+        if (d) {
+            refcount_inc(&d->ref);
+            scc_flow_list(dsk);
+        }
+        release_sock(dsk);
+        if (!d)
+            goto out;
+    }
+    lock_sock(usk);
+    u = scc_link_flow(usk);
+    if (u) {
+        if (d)
+            atomic_inc(&d->link.followers);
+        WRITE_ONCE(u->link.peer_cookie, src);
+        old = rcu_replace_pointer(u->link.peer, d, lockdep_sock_is_held(usk));
+        d = NULL;
+        scc_flow_list(usk);
+        ret = 0;
+    }
+    release_sock(usk);
+    scc_link_unfollow(old);
+out:
+    scc_flow_put(d);
+    if (dsk)
+        sock_put(dsk);
+    sock_put(usk);
+    return ret;
+}
+
+static int scc_link_write(struct file *file, char *buf, size_t len)
+{
+    struct net *net = current->nsproxy->net_ns;
+    u64 cookie, src;
+
+    if (seq_file_single_net(file->private_data) != net)
+        return -EPERM;
+    if (sscanf(buf, "%llu %llu", &cookie, &src) != 2 || !cookie ||
+        cookie == src)
+        return -EINVAL;
+    return scc_link(net, cookie, src);
+}
+
+static int scc_link_show(struct seq_file *seq, void *v)
+{
+    struct scc_net *sn = scc_net(seq_file_single_net(seq));
+    const struct scc_flow *f, *p;
+
+    seq_puts(seq, "id cookie peer peer_cookie rate cap\n");
+    rcu_read_lock();
+    spin_lock_bh(&sn->lock);
+    list_for_each_entry(f, &sn->flows, node) {
+        p = rcu_dereference(f->link.peer);
+        if (!p && !atomic_read(&f->link.followers))
+            continue;
+        seq_printf(seq, "%u %llu %u %llu %u %u\n", f->id,
+            atomic64_read(&f->sk->sk_cookie), p ? p->id : 0,
+            f->link.peer_cookie, f->link.rate, f->link.cap);
+    }
+    spin_unlock_bh(&sn->lock);
+    rcu_read_unlock();
+    return 0;
+}
+
+/* Случайные и перегрузочные потери. loss_rate и lt-выборка считали все
+    потери одинаково, и на беспроводных и дальних путях одиночные случайные
+    потери при пустой очереди заставляли Spline отступать зря. Эпизод - потери
+    одного раунда; решение по нему принимается на границе раунда, а до того
+    его потери не видны ни loss_rate, ни lt-выборке, ни оценке буфера
+    (scc_cong_lost). Эпизод случайный, если в нем не больше
+    scc_loss_random_run потерь, очередь при каждой потере ниже 1/8 min RTT
+    (и ниже половины буфера, если он известен) и ни на одном ACK с потерей
+    узкое место не растягивало наши пакеты (rcv_interval не больше
+    snd_interval + 1/16) - то есть темп доставки не уперся в емкость.
+    Случайные потери копятся отдельно (random_lost в итогах соединения) и не
+    доходят до loss_cnt и loss_backoff_cwnd; перегрузочные идут как раньше,
+    с задержкой до раунда. lost_recent, сторож и гарантия минимума темпа
+    по-прежнему видят все потери. */
+static const u32 scc_loss_random_run = 2;
+
+static u32 scc_cong_lost(struct sock *sk)
+{
+    struct scc_flow *f = scc_flow(sk);
+    struct tcp_sock *tp = tcp_sk(sk);
+
+    return f ? tp->lost - f->loss.random - f->loss.run : tp->lost;
+}
+
+static void scc_loss_update(struct sock *sk, const struct rate_sample *rs)
+{
+    struct scc_flow *f = scc_flow(sk);
+    struct scc *scc = inet_csk_ca(sk);
+    struct scc_loss *l;
+    u32 qthr, q;
+
+    if (!f)
+        return;
+    l = &f->loss;
+    if (scc->round_start && l->run) {
+        qthr = BBR_UNIT >> 3;
+        if (f->buf.cls != SPLINE_BUF_UNKNOWN)
+            qthr = min_t(u32, qthr, f->buf.depth >> 1);
+        if (l->run <= scc_loss_random_run && l->qmax < qthr && !l->sat)
+            l->random += l->run;
+        l->run = 0;
+        l->qmax = 0;
+        l->sat = 0;
+    }
+    if (rs->losses <= 0)
+        return;
+
+    l->run += rs->losses;
+    if (rs->rtt_us > 0 && scc->last_min_rtt) {
+        q = rs->rtt_us > scc->last_min_rtt ?
+            min_t(u64, div_u64((u64)(rs->rtt_us - scc->last_min_rtt) << BBR_SCALE,
+                scc->last_min_rtt), U16_MAX) : 0;
+        l->qmax = max_t(u32, l->qmax, q);
+    }
+    if (rs->snd_interval_us &&
+        rs->rcv_interval_us > rs->snd_interval_us + (rs->snd_interval_us >> 4))
+        l->sat = 1;
+}
+
+/* Глубина буфера узкого места. Очередь перед первой потерей после раунда
+    без потерь - это полный буфер, поэтому max RTT - min RTT такого раунда в
+    долях min RTT дает буфер в долях BDP (bw * min RTT): EWMA 1/4 по началам
+    потерь. Очередь без потерь - нижняя граница, до нее оценка поднимается
+    сразу. Классы с гистерезисом 1/8: мелкий (меньше 1/2 BDP) - только после
+    начала потерь, глубокий (больше 2 BDP) - и по очереди без потерь.
+    Мелкий буфер: pacing_gain не выше 5/4 и окно не выше BDP + буфер (не
+    меньше 5/4 BDP), перелет пробы все равно теряется. Глубокий: окно не
+    выше 3/2 BDP, то есть очередь не больше min RTT / 2, потерь там ждать
+    долго. На пути с AQM потери начинаются при малой очереди, и он честно
+    выглядит мелким. */
+static void scc_buf_update(struct sock *sk, const struct rate_sample *rs)
+{
+    struct scc_flow *f = scc_flow(sk);
+    struct scc *scc = inet_csk_ca(sk);
+    struct tcp_sock *tp = tcp_sk(sk);
+    struct scc_buf *b;
+    u32 lost, q, d;
+
+    if (!f)
+        return;
+    b = &f->buf;
+    if (rs->rtt_us > 0)
+        b->rtt_max = max_t(u32, b->rtt_max, rs->rtt_us);
+    if (!scc->round_start || !scc->last_min_rtt)
+        return;
+
+    lost = scc_cong_lost(sk) - b->lost;
+    b->lost = scc_cong_lost(sk);
+    q = b->rtt_max > scc->last_min_rtt ?
+        min_t(u64, div_u64((u64)(b->rtt_max - scc->last_min_rtt) << BBR_SCALE,
+            scc->last_min_rtt), U16_MAX) : 0;
+    b->rtt_max = 0;
+
+    if (lost && !b->lossy) {
+        b->depth = b->onsets ? b->depth - (b->depth >> 2) + (q >> 2) : q;
+        if (b->onsets < U8_MAX)
+            b->onsets++;
+    } else if (q > b->depth) {
+        b->depth = q;
+    }
+    b->lossy = !!lost;
+
+    d = b->depth;
+    switch (b->cls) {
+    case SPLINE_BUF_SHALLOW:
+        if (d > (BBR_UNIT >> 1) + (BBR_UNIT >> 3))
+            b->cls = SPLINE_BUF_BDP;
+        break;
+    case SPLINE_BUF_DEEP:
+        if (d < (BBR_UNIT << 1) - (BBR_UNIT >> 3))
+            b->cls = b->onsets ? SPLINE_BUF_BDP : SPLINE_BUF_UNKNOWN;
+        break;
+    default:
+        if (d > BBR_UNIT << 1)
+            b->cls = SPLINE_BUF_DEEP;
+        else if (b->onsets && d < BBR_UNIT >> 1)
+            b->cls = SPLINE_BUF_SHALLOW;
+        else if (b->onsets)
+            b->cls = SPLINE_BUF_BDP;
+    }
+}
+
+static u8 scc_buf_class(struct sock *sk)
+{
+    struct scc_flow *f = scc_flow(sk);
+
+    return f ? f->buf.cls : SPLINE_BUF_UNKNOWN;
+}
+
+/* Потолок окна по классу буфера, сегменты; U32_MAX - без потолка */
+static u32 scc_buf_cap(struct sock *sk)
+{
+    struct scc_flow *f = scc_flow(sk);
+    u32 gain;
+
+    if (!f)
+        return U32_MAX;
+    switch (f->buf.cls) {
+    case SPLINE_BUF_SHALLOW:
+        gain = max_t(u32, BW_UNIT + ((u32)f->buf.depth << (BW_SCALE_2 - BBR_SCALE)),
+            BW_UNIT * 5 / 4);
+        break;
+    case SPLINE_BUF_DEEP:
+        gain = BW_UNIT * 3 / 2;
+        break;
+    default:
+        return U32_MAX;
+    }
+    return scc_bdp(sk, scc_bw(sk), gain);
+}
+
+static void spline_update(struct sock *sk,
+    const struct rate_sample *rs)
+{
+    struct scc *scc = inet_csk_ca(sk);
+    update_min_rtt(sk, rs);
+    update_last_acked_sacked(sk, rs);
+    scc_update_bw(sk, rs);
+    scc_loss_update(sk, rs);
+    scc_update_xt_share(sk, rs);
+    scc_sbd_update(sk, rs);
+    scc_summary_update(sk, rs);
+    scc_min_rate_update(sk);
+    scc_link_update(sk);
+    scc_buf_update(sk, rs);
+    fairness_check(sk);
+    high_rtt_round(sk);
+    stable_check(sk);
+    loss_rate(sk);
+    scc_update_lost_recent(sk);
+    spline_watchdog(sk, rs);
+    scc_desync_update(sk);
+    update_probes(sk, rs);
+}
+
+/*На данном этапе, идет выборка между двумя cwnd или их общая сглаженная. cwnd_spline(cwnd) и 
+    target_cwnd(scc_bdp и BBR подобных вычислений).
+    Какой из этих cwnd более предпочителен для текущей состоянии сети?*/
+static u32 next_cwnd(struct sock *sk, const struct rate_sample *rs,
+ u32 target_cwnd, u32 cwnd)
+{
+    struct scc *scc = inet_csk_ca(sk);
+    u64 tf = percent_gain(scc->lost_recent, scc->stable_flag, scc->unfair_flag);
+    struct spline_cwnd_ctx ctx;
+    int override;
+
+    if (scc->current_mode == MODE_DRAIN_PROBE) {
+        ctx.cwnd = min(target_cwnd, cwnd);
+        ctx.branch = SPLINE_CWND_DRAIN;
+    } else if (scc_unresp(sk)) {
+        ctx.cwnd = scc_bdp(sk, scc_bw(sk), scc_unresp_cwnd_gain);
+        ctx.branch = SPLINE_CWND_UNRESP;
+    }
+    else if(tf < thresh_tf && !scc->start_phase &&
+        scc->loss_cnt > 50){
+        ctx.cwnd = cwnd;
+        ctx.branch = SPLINE_CWND_LOSS;
+    }
+    else if(((scc->unfair_flag > 2000 && scc->stable_flag < 300) ||
+        scc->unfair_flag > scc->stable_flag + 500) && scc->loss_cnt > 5) {
+        ctx.cwnd = ((target_cwnd + cwnd) * 7) >> 4;
+        ctx.branch = SPLINE_CWND_UNFAIR;
+    } else {
+        ctx.cwnd = max(target_cwnd, cwnd);
+        ctx.branch = SPLINE_CWND_MAX;
+    }
+
+    ctx.target_cwnd = target_cwnd;
+    ctx.curr_cwnd = cwnd;
+    ctx.__pad = 0;
+    ctx.tf = tf;
+    ctx.unfair_flag = scc->unfair_flag;
+    ctx.stable_flag = scc->stable_flag;
+    ctx.loss_cnt = scc->loss_cnt;
+    ctx.mode = scc->current_mode;
+    ctx.start_phase = scc->start_phase;
+    ctx.sbd_group = scc_sbd_group(sk);
+    ctx.buf_class = scc_buf_class(sk);
+    if (scc->current_mode != MODE_START_PROBE)
+        ctx.cwnd = min(ctx.cwnd, max(scc_buf_cap(sk), SCC_MIN_SND_CWND));
+
+    override = spline_next_cwnd_hook(sk, &ctx);
+    return override > 0 ? (u32)override : ctx.cwnd;
+}
+
+static void spline_cwnd_send(struct sock *sk, const struct rate_sample *rs, u32 bw)
+{
+    struct scc *scc = inet_csk_ca(sk);
+    struct tcp_sock *tp = tcp_sk(sk);
+    u64 tf = percent_gain(scc->lost_recent, scc->stable_flag, scc->unfair_flag);
+    u32 cwnd_segments, target_cwnd, max_cwnd;
+    target_cwnd = scc_bdp(sk, bw, scc_rtt_fair_gain(sk, scc->cwnd_gain, BW_UNIT));
+    cwnd_segments = next_cwnd(sk, rs, target_cwnd, scc->curr_cwnd);
+    cwnd_segments = max(cwnd_segments, SCC_MIN_SND_CWND);
+    cwnd_segments = max(cwnd_segments, scc_min_rate_cwnd(sk));
+    cwnd_segments += rs->acked_sacked;
+    tcp_snd_cwnd_set(tp, min(cwnd_segments, tp->snd_cwnd_clamp));
+}
+
+static void spline_main(struct sock *sk, const struct rate_sample *rs)
+{
+    struct tcp_sock *tp = tcp_sk(sk);
+    struct scc *scc = inet_csk_ca(sk);
+    u32 bw;
+    scc->curr_cwnd = tcp_snd_cwnd(tp);
+    spline_update(sk, rs);
+    bw = scc_bw(sk);
+    bbr_set_pacing_rate(sk, bw, scc_app_probe(sk, rs,
+        scc_rtt_fair_gain(sk, scc->pacing_gain, BBR_UNIT)));
 
     tp->snd_ssthresh = TCP_INFINITE_SSTHRESH;
     spline_cwnd_send(sk, rs, bw);
@@ -885,6 +2621,7 @@ static void spline_set_state(struct sock *sk, u8 new_state)
         scc->prev_ca_state = TCP_CA_Loss;
         scc->round_start = 1;
         scc_lt_bw_sampling(sk, &rs);
+        scc_desync_arm(sk);
     }
 }
 
@@ -892,15 +2629,19 @@ static void spline_init(struct sock *sk)
 {
     struct scc *scc = inet_csk_ca(sk);
     struct tcp_sock *tp = tcp_sk(sk);
+    scc_flow_alloc(sk);
     scc->last_min_rtt = tcp_min_rtt(tp);
     scc->curr_rtt = 0;
     scc->curr_ack = 0;
     scc->last_ack = 0;
-    scc->fairness_rat = 0;
+    scc->xt_rate = 0;
+    scc->xt_ratio = 0;
+    scc->xt_var = 0;
+    scc->xt_cov = 0;
+    scc->xt_share = 0;
     scc->epp = 0;
     scc->curr_cwnd = SCC_MIN_SND_CWND;
     scc->current_mode = MODE_START_PROBE;
-    scc->cycle_mstamp = 0;
     scc->lt_rtt_cnt = 0;
     scc->EPOCH_ROUND = 10 + (get_random_u32() % 31);
     scc->rtt_epoch = 4000;
@@ -909,14 +2650,27 @@ static void spline_init(struct sock *sk)
     scc->high_round = 0;
     scc->unfair_flag = 0;
     scc->stable_flag = 0;
-    scc->cycle_mstamp = 0;
-    scc->rtt_cnt = 0;
     scc->loss_cnt = 0;
+    scc->wd_rounds = 0;
+    scc->wd_lost = tp->lost;
+    scc->bw_var = 0;
+    scc->bw_outliers = 0;
+    scc->lost_recent = 0;
+    scc->lost_rounds = 0;
+    scc->rtt_forced = 0;
+    scc->desync = 0;
+    scc->desync_on = 0;
     bbr_init_pacing_rate_from_rtt(sk);
     scc->round_start = 0;
     scc_reset_lt_bw_sampling(sk);
 }
 
+static void spline_release(struct sock *sk)
+{
+    scc_summary_emit(sk);
+    scc_flow_free(sk);
+}
+
 static u32 spline_ssthresh(struct sock *sk)
 {
     spline_save_cwnd(sk);
@@ -928,6 +2682,30 @@ static u32 spline_sndbuf_expand(struct sock *sk)
     return 3;
 }
 
+/* Отдаем оценки через inet_diag в формате BBR, чтобы их видели ss и сборщики
+    метрик. cwnd_gain у Spline в Q24, приводим к Q8 как у BBR. */
+static size_t spline_get_info(struct sock *sk, u32 ext, int *attr,
+                  union tcp_cc_info *info)
+{
+    if (ext & (1 << (INET_DIAG_BBRINFO - 1)) ||
+        ext & (1 << (INET_DIAG_VEGASINFO - 1))) {
+        struct tcp_sock *tp = tcp_sk(sk);
+        struct scc *scc = inet_csk_ca(sk);
+        u64 bw = scc_bw(sk);
+
+        bw = bw * tp->mss_cache * USEC_PER_SEC >> BW_SCALE_2;
+        memset(&info->bbr, 0, sizeof(info->bbr));
+        info->bbr.bbr_bw_lo         = (u32)bw;
+        info->bbr.bbr_bw_hi         = (u32)(bw >> 32);
+        info->bbr.bbr_min_rtt       = scc->last_min_rtt;
+        info->bbr.bbr_pacing_gain   = scc->pacing_gain;
+        info->bbr.bbr_cwnd_gain     = scc->cwnd_gain >> (BW_SCALE_2 - BBR_SCALE);
+        *attr = INET_DIAG_BBRINFO;
+        return sizeof(info->bbr);
+    }
+    return 0;
+}
+
 static void spline_cwnd_event(struct sock *sk, enum tcp_ca_event event)
 {
     struct tcp_sock *tp = tcp_sk(sk);
@@ -939,14 +2717,48 @@ static void spline_cwnd_event(struct sock *sk, enum tcp_ca_event event)
     }
 }
 
+static int __net_init scc_net_init(struct net *net)
+{
+    struct scc_net *sn = scc_net(net);
+
+    spin_lock_init(&sn->lock);
+    INIT_LIST_HEAD(&sn->flows);
+    INIT_WORK(&sn->sbd_work, scc_sbd_regroup);
+    if (!proc_create_net_single("spline_sbd", 0444, net->proc_net,
+        scc_sbd_show, NULL))
+        return -ENOMEM;
+    if (!proc_create_net_single_write("spline_link", 0600, net->proc_net,
+        scc_link_show, scc_link_write, NULL)) {
+        remove_proc_entry("spline_sbd", net->proc_net);
+        return -ENOMEM;
+    }
+    return 0;
+}
+
+static void __net_exit scc_net_exit(struct net *net)
+{
+    cancel_work_sync(&scc_net(net)->sbd_work);
+    remove_proc_entry("spline_link", net->proc_net);
+    remove_proc_entry("spline_sbd", net->proc_net);
+}
+
+static struct pernet_operations scc_net_ops = {
+    .init   = scc_net_init,
+    .exit   = scc_net_exit,
+    .id     = &scc_net_id,
+    .size   = sizeof(struct scc_net),
+};
+
 static struct tcp_congestion_ops spline_cc_ops __read_mostly = {
     .init           = spline_init,
+    .release        = spline_release,
     .ssthresh       = spline_ssthresh,
     .cong_control   = spline_main,
     .sndbuf_expand  = spline_sndbuf_expand,
     .cwnd_event     = spline_cwnd_event,
     .undo_cwnd      = spline_undo_cwnd,
     .set_state      = spline_set_state,
+    .get_info       = spline_get_info,
     .owner          = THIS_MODULE,
     .name           = "spline",
 };
@@ -957,9 +2769,15 @@ static int __init spline_cc_register(void)
 
     BUILD_BUG_ON(sizeof(struct scc) > ICSK_CA_PRIV_SIZE);
 
+    ret = register_pernet_subsys(&scc_net_ops);
+    if (ret < 0) {
+        pr_err("spline: pernet registration failed with error %d\n", ret);
+        return ret;
+    }
     ret = tcp_register_congestion_control(&spline_cc_ops);
     if (ret < 0) {
         pr_err("spline: registration failed with error %d\n", ret);
+        unregister_pernet_subsys(&scc_net_ops);
         return ret;
     }
 
@@ -970,6 +2788,7 @@ static int __init spline_cc_register(void)
 static void __exit spline_cc_unregister(void)
 {
     tcp_unregister_congestion_control(&spline_cc_ops);
+    unregister_pernet_subsys(&scc_net_ops);
 }
 
 module_init(spline_cc_register);
@@ -0,0 +1,314 @@
+#!/usr/bin/env python3
+"""Fleet telemetry exporter for Spline sockets.
+
+  spline_exporter.py [--iter /sys/fs/bpf/spline_iter] [--interval 10]
+                     [--listen 127.0.0.1:9405] [--file PATH]
+                     [--prefix4 24] [--prefix6 48]
+                     [--sbd /proc/net/spline_sbd]
+
+Every interval all Spline sockets on the host are sampled and folded into
+cumulative histograms labelled by destination prefix, exported in
+OpenMetrics text over HTTP (/metrics) and/or written atomically to a file.
+
+Sources, in order of preference:
+  --iter   a pinned spline_iter.bpf.o iterator: mode, cwnd, bw, min/current
+           RTT, loss_cnt, loss backoffs and watchdog resets straight from
+           struct scc and its per-flow state
+  inet_diag (ss -tin): bw, min RTT and gains from spline_get_info and cwnd,
+           RTT from tcp_info; no mode, loss backoffs or watchdog resets
+
+Exported families:
+  spline_sockets                    sockets seen in the last sample
+  spline_mode_samples_total         socket samples per mode (mode residency)
+  spline_cwnd_bdp_ratio             cwnd / (bw * min_rtt)
+  spline_queue_delay_seconds        current RTT - min RTT
+  spline_loss_backoffs_total        loss_backoff_cwnd cuts seen between samples
+  spline_socket_loss_backoffs       per-socket loss backoffs at sample time
+  spline_watchdog_resets_total      watchdog state resets seen between samples
+  spline_sbd_bottlenecked_flows     flows the shared-bottleneck detector sees
+                                    at a bottleneck (--sbd)
+  spline_sbd_groups                 groups of flows sharing one bottleneck
+  spline_sbd_group_prefixes         destination prefixes per group; a group
+                                    spanning many is a bottleneck near the host
+"""
+
+import argparse
+import http.server
+import ipaddress
+import os
+import re
+import subprocess
+import threading
+import time
+
+MODES = ("start_probe", "probe_bw", "probe_rtt", "drain_probe")
+BW_UNIT = 1 << 24
+
+BUCKETS = {
+    "spline_cwnd_bdp_ratio": (0.25, 0.5, 0.75, 1.0, 1.25, 1.5, 2.0, 3.0, 4.0, 8.0),
+    "spline_queue_delay_seconds": (0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.2, 0.5, 1.0),
+    "spline_socket_loss_backoffs": (0, 1, 2, 5, 10, 20, 50, 100, 1000),
+    "spline_sbd_group_prefixes": (1, 2, 4, 8, 16, 32, 64),
+}
+HELP = {
+    "spline_sockets": ("gauge", "Spline sockets seen in the last sample"),
+    "spline_mode_samples": ("counter", "Socket samples per Spline mode"),
+    "spline_cwnd_bdp_ratio": ("histogram", "cwnd divided by bw * min_rtt"),
+    "spline_queue_delay_seconds": ("histogram", "Smoothed RTT minus min RTT"),
+    "spline_loss_backoffs": ("counter", "loss_backoff_cwnd window cuts"),
+    "spline_socket_loss_backoffs": ("histogram", "Per-socket loss backoff count"),
+    "spline_watchdog_resets": ("counter", "Watchdog resets of wedged state"),
+    "spline_sbd_bottlenecked_flows": ("gauge", "Flows at a bottleneck in the last sample"),
+    "spline_sbd_groups": ("gauge", "Groups of flows sharing a bottleneck in the last sample"),
+    "spline_sbd_group_prefixes": ("histogram", "Destination prefixes per shared-bottleneck group"),
+}
+
+
+class Histogram:
+    def __init__(self, bounds):
+        self.bounds = bounds
+        self.counts = [0] * (len(bounds) + 1)
+        self.sum = 0.0
+
+    def observe(self, v):
+        for i, b in enumerate(self.bounds):
+            if v <= b:
+                self.counts[i] += 1
+                break
+        else:
+            self.counts[-1] += 1
+        self.sum += v
+
+
+class Store:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.sockets = {}
+        self.modes = {}
+        self.backoffs = {}
+        self.resets = {}
+        self.hists = {name: {} for name in BUCKETS}
+        self.last_backoff = {}
+        self.last_resets = {}
+        self.bottlenecked = {}
+        self.groups = None
+
+    def hist(self, name, prefix):
+        h = self.hists[name]
+        if prefix not in h:
+            h[prefix] = Histogram(BUCKETS[name])
+        return h[prefix]
+
+    @staticmethod
+    def delta(now, prev):
+        # A smaller value means a new socket reused the same key.
+        return now - prev if now >= prev else now
+
+    def ingest(self, socks):
+        with self.lock:
+            self.sockets = {}
+            seen, seen_resets = {}, {}
+            for s in socks:
+                p = s["prefix"]
+                self.sockets[p] = self.sockets.get(p, 0) + 1
+                if s.get("mode") is not None:
+                    k = (p, MODES[s["mode"]] if s["mode"] < len(MODES) else str(s["mode"]))
+                    self.modes[k] = self.modes.get(k, 0) + 1
+                bdp = s["bw_bps"] / 8 * s["min_rtt_us"] / 1e6
+                if bdp > 0:
+                    self.hist("spline_cwnd_bdp_ratio", p).observe(s["cwnd"] * s["mss"] / bdp)
+                qd = max(s["curr_rtt_us"] - s["min_rtt_us"], 0) / 1e6
+                self.hist("spline_queue_delay_seconds", p).observe(qd)
+                if s.get("backoff") is not None:
+                    delta = self.delta(s["backoff"], self.last_backoff.get(s["key"], 0))
+                    self.backoffs[p] = self.backoffs.get(p, 0) + delta
+                    self.hist("spline_socket_loss_backoffs", p).observe(s["backoff"])
+                    seen[s["key"]] = s["backoff"]
+                if s.get("wd_resets") is not None:
+                    delta = self.delta(s["wd_resets"], self.last_resets.get(s["key"], 0))
+                    self.resets[p] = self.resets.get(p, 0) + delta
+                    seen_resets[s["key"]] = s["wd_resets"]
+            self.last_backoff = seen
+            self.last_resets = seen_resets
+
+    def ingest_sbd(self, flows):
+        with self.lock:
+            self.bottlenecked = {}
+            groups = {}
+            for group, prefix in flows:
+                self.bottlenecked[prefix] = self.bottlenecked.get(prefix, 0) + 1
+                groups.setdefault(group, set()).add(prefix)
+            self.groups = len(groups)
+            for prefixes in groups.values():
+                self.hist("spline_sbd_group_prefixes", "all").observe(len(prefixes))
+
+    def render(self):
+        out = []
+        with self.lock:
+            def head(name):
+                typ, text = HELP[name]
+                out.append(f"# TYPE {name} {typ}")
+                out.append(f"# HELP {name} {text}")
+
+            head("spline_sockets")
+            for p, n in sorted(self.sockets.items()):
+                out.append(f'spline_sockets{{prefix="{p}"}} {n}')
+            head("spline_mode_samples")
+            for (p, m), n in sorted(self.modes.items()):
+                out.append(f'spline_mode_samples_total{{prefix="{p}",mode="{m}"}} {n}')
+            head("spline_loss_backoffs")
+            for p, n in sorted(self.backoffs.items()):
+                out.append(f'spline_loss_backoffs_total{{prefix="{p}"}} {n}')
+            head("spline_watchdog_resets")
+            for p, n in sorted(self.resets.items()):
+                out.append(f'spline_watchdog_resets_total{{prefix="{p}"}} {n}')
+            if self.groups is not None:
+                head("spline_sbd_bottlenecked_flows")
+                for p, n in sorted(self.bottlenecked.items()):
+                    out.append(f'spline_sbd_bottlenecked_flows{{prefix="{p}"}} {n}')
+                head("spline_sbd_groups")
+                out.append(f"spline_sbd_groups {self.groups}")
+            for name in BUCKETS:
+                head(name)
+                for p, h in sorted(self.hists[name].items()):
+                    acc = 0
+                    for b, c in zip(list(h.bounds) + ["+Inf"], h.counts):
+                        acc += c
+                        out.append(f'{name}_bucket{{prefix="{p}",le="{b}"}} {acc}')
+                    out.append(f'{name}_count{{prefix="{p}"}} {acc}')
+                    out.append(f'{name}_sum{{prefix="{p}"}} {h.sum:g}')
+        out.append("# EOF")
+        return "\n".join(out) + "\n"
+
+
+def prefix_of(addr, p4, p6):
+    ip = ipaddress.ip_address(addr.split("%")[0])
+    bits = p4 if ip.version == 4 else p6
+    return str(ipaddress.ip_network(f"{ip}/{bits}", strict=False))
+
+
+def sample_iter(path, p4, p6):
+    socks = []
+    with open(path) as f:
+        for line in f:
+            v = line.split()
+            if len(v) != 13:
+                continue
+            fam, daddr, dport, sport, mode, cwnd, mss, bw, mrtt, crtt, _loss, boff, wdr = v
+            mss = int(mss)
+            socks.append({
+                "key": (daddr, dport, sport),
+                "prefix": prefix_of(daddr, p4, p6),
+                "mode": int(mode), "cwnd": int(cwnd), "mss": mss,
+                "bw_bps": int(bw) * mss * 1e6 / BW_UNIT * 8,
+                "min_rtt_us": int(mrtt), "curr_rtt_us": int(crtt),
+                "backoff": int(boff), "wd_resets": int(wdr),
+            })
+    return socks
+
+
+def sample_sbd(path, p4, p6):
+    """(group, destination prefix) of every flow at a bottleneck."""
+    flows = []
+    with open(path) as f:
+        next(f, None)
+        for line in f:
+            v = line.split()
+            if len(v) != 11 or v[1] == "0":
+                continue
+            daddr = v[10].rsplit(":", 1)[0].strip("[]")
+            flows.append((int(v[1]), prefix_of(daddr, p4, p6)))
+    return flows
+
+
+RATE = {"": 1, "K": 1e3, "M": 1e6, "G": 1e9}
+
+
+def sample_ss(p4, p6):
+    txt = subprocess.run(["ss", "-tinH", "state", "established"],
+                         capture_output=True, text=True).stdout
+    socks, entries = [], []
+    # ss prints each socket on one line and its tcp_info on an indented
+    # continuation line.
+    for line in txt.splitlines():
+        if line[:1].isspace() and entries:
+            entries[-1][1] += line
+        else:
+            entries.append([line, ""])
+    for addr_line, info in entries:
+        if not re.search(r"\bspline\b", info):
+            continue
+        peer = addr_line.split()[3]
+        daddr = peer.rsplit(":", 1)[0].strip("[]")
+        bw = re.search(r"bbr:\(bw:([\d.]+)([KMG]?)bps,mrtt:([\d.]+)", info)
+        rtt = re.search(r"\brtt:([\d.]+)/", info)
+        cwnd = re.search(r"\bcwnd:(\d+)", info)
+        mss = re.search(r"\bmss:(\d+)", info)
+        if not (bw and rtt and cwnd and mss):
+            continue
+        socks.append({
+            "key": peer,
+            "prefix": prefix_of(daddr, p4, p6),
+            "mode": None, "backoff": None, "wd_resets": None,
+            "cwnd": int(cwnd.group(1)), "mss": int(mss.group(1)),
+            "bw_bps": float(bw.group(1)) * RATE[bw.group(2)],
+            "min_rtt_us": float(bw.group(3)) * 1e3,
+            "curr_rtt_us": float(rtt.group(1)) * 1e3,
+        })
+    return socks
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument("--iter", default="/sys/fs/bpf/spline_iter")
+    p.add_argument("--interval", type=float, default=10.0)
+    p.add_argument("--listen", default="127.0.0.1:9405")
+    p.add_argument("--file")
+    p.add_argument("--prefix4", type=int, default=24)
+    p.add_argument("--prefix6", type=int, default=48)
+    p.add_argument("--sbd", default="/proc/net/spline_sbd")
+    a = p.parse_args()
+
+    store = Store()
+
+    class Handler(http.server.BaseHTTPRequestHandler):
+        def do_GET(self):
+            if self.path != "/metrics":
+                self.send_error(404)
+                return
+            body = store.render().encode()
+            self.send_response(200)
+            self.send_header("Content-Type",
+                             "application/openmetrics-text; version=1.0.0; charset=utf-8")
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+
+        def log_message(self, *args):
+            pass
+
+    if a.listen:
+        host, port = a.listen.rsplit(":", 1)
+        srv = http.server.ThreadingHTTPServer((host, int(port)), Handler)
+        threading.Thread(target=srv.serve_forever, daemon=True).start()
+
+    while True:
+        t0 = time.monotonic()
+        if a.iter and os.path.exists(a.iter):
+            socks = sample_iter(a.iter, a.prefix4, a.prefix6)
+        else:
+            socks = sample_ss(a.prefix4, a.prefix6)
+        store.ingest(socks)
+        if a.sbd and os.path.exists(a.sbd):
+            store.ingest_sbd(sample_sbd(a.sbd, a.prefix4, a.prefix6))
+        if a.file:
+            tmp = a.file + ".tmp"
+            with open(tmp, "w") as f:
+                f.write(store.render())
+            os.replace(tmp, a.file)
+        time.sleep(max(0.0, a.interval - (time.monotonic() - t0)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: GPL-2.0
+/* BPF iterator over TCP sockets that dumps the private state of every Spline
+ * socket, one line per socket:
+ *
+ *   family daddr dport sport mode cwnd mss bw min_rtt_us curr_rtt_us loss_cnt
+ *   backoffs wd_resets
+ *
+ * bw is scc->bw as is (Q24 packets per usec). The two counters live in the
+ * per-flow state behind scc->flow and read as 0 when the module had no memory
+ * for it. The structs below are subsets of the module's definitions; CO-RE
+ * relocates the offsets against the module BTF, so they keep working when
+ * fields are added or reordered there.
+ *
+ * Build and pin (module loaded, built with BTF):
+ *   bpftool btf dump file /sys/kernel/btf/vmlinux format c > vmlinux.h
+ *   clang -O2 -g -target bpf -c spline_iter.bpf.c -o spline_iter.bpf.o
+ *   bpftool iter pin spline_iter.bpf.o /sys/fs/bpf/spline_iter
+ * Every read of /sys/fs/bpf/spline_iter runs one walk over the TCP hash.
+ */
+#include "vmlinux.h"
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_core_read.h>
+#include <bpf/bpf_endian.h>
+
+#define AF_INET     2
+#define AF_INET6    10
+
+char LICENSE[] SEC("license") = "GPL";
+
+struct scc_summary {
+    u16 backoffs;
+    u16 wd_resets;
+} __attribute__((preserve_access_index));
+
+struct scc_flow {
+    struct scc_summary sum;
+} __attribute__((preserve_access_index));
+
+struct scc {
+    u32 last_min_rtt;
+    u32 curr_rtt;
+    u32 bw;
+    u32 current_mode:3,
+        loss_cnt:8;
+    struct scc_flow *flow;
+} __attribute__((preserve_access_index));
+
+SEC("iter/tcp")
+int dump_spline(struct bpf_iter__tcp *ctx)
+{
+    struct sock_common *skc = ctx->sk_common;
+    struct seq_file *seq = ctx->meta->seq;
+    const struct tcp_congestion_ops *ops;
+    struct tcp_sock *tp;
+    struct scc *scc;
+    char name[16];
+    u16 family;
+
+    if (!skc)
+        return 0;
+    tp = bpf_skc_to_tcp_sock(skc);
+    if (!tp)
+        return 0;
+
+    ops = tp->inet_conn.icsk_ca_ops;
+    if (!ops || bpf_probe_read_kernel_str(name, sizeof(name), ops->name) < 0)
+        return 0;
+    if (__builtin_memcmp(name, "spline", sizeof("spline")))
+        return 0;
+
+    scc = (struct scc *)&tp->inet_conn.icsk_ca_priv;
+    family = skc->skc_family;
+    if (family == AF_INET)
+        BPF_SEQ_PRINTF(seq, "4 %pI4 ", &skc->skc_daddr);
+    else if (family == AF_INET6)
+        BPF_SEQ_PRINTF(seq, "6 %pI6c ", &skc->skc_v6_daddr);
+    else
+        return 0;
+
+    BPF_SEQ_PRINTF(seq, "%u %u %u %u %u %u %u %u %u %u %u\n",
+               bpf_ntohs(skc->skc_dport), skc->skc_num,
+               (u32)BPF_CORE_READ_BITFIELD_PROBED(scc, current_mode),
+               tp->snd_cwnd, tp->mss_cache, BPF_CORE_READ(scc, bw),
+               BPF_CORE_READ(scc, last_min_rtt), BPF_CORE_READ(scc, curr_rtt),
+               (u32)BPF_CORE_READ_BITFIELD_PROBED(scc, loss_cnt),
+               (u32)BPF_CORE_READ(scc, flow, sum.backoffs),
+               (u32)BPF_CORE_READ(scc, flow, sum.wd_resets));
+    return 0;
+}
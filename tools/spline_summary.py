@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+"""Stream one summary record per closed Spline connection as JSON lines.
+
+  spline_summary.py [--duration SECONDS] [--output FILE]
+
+bpftrace attaches to spline_conn_end_hook, which the module calls once from
+spline_release with a struct spline_conn_summary, and prints it through its
+perf/ring buffer; every record is written as one JSON object per line:
+
+  local, remote           4-tuple
+  bytes_acked, bytes_sent
+  duration_ms             from spline_init to release
+  mode_ms                 time per mode (START, PROBE_BW, PROBE_RTT, DRAIN)
+  bw_max_mbit, bw_median_mbit
+                          max and streaming median of the per-round bw
+  min_rtt_ms, qdelay_p90_ms
+                          min RTT and streaming p90 of RTT - min RTT
+  retrans, loss_backoffs, lt_policer, wd_resets
+  min_rtt_drains          DRAINs forced to measure the min RTT, started or
+                          joined from the flow's bottleneck group
+  has_flow                0 when the module had no memory for the flow's
+                          state; everything but bytes, min RTT and retrans
+                          is then missing
+  buf_kbytes, buf_class   bottleneck buffer estimate and its class (unknown,
+                          shallow, bdp, deep)
+  random_lost             lost packets classed as random, kept out of the
+                          loss backoff
+
+Runs until --duration passes or it is interrupted.
+"""
+
+import argparse
+import json
+import signal
+import subprocess
+import sys
+
+MODES = ("START", "PROBE_BW", "PROBE_RTT", "DRAIN")
+BUF_CLASSES = ("unknown", "shallow", "bdp", "deep")
+
+PROG = r'''
+kprobe:spline_conn_end_hook
+{
+    $sk = (struct sock *)arg0;
+    $s = (struct spline_conn_summary *)arg1;
+    $d = $sk->__sk_common.skc_dport;
+    if ($sk->__sk_common.skc_family == 10) {
+        printf("%s %u %s %u ",
+            ntop($sk->__sk_common.skc_v6_rcv_saddr.in6_u.u6_addr8),
+            $sk->__sk_common.skc_num,
+            ntop($sk->__sk_common.skc_v6_daddr.in6_u.u6_addr8),
+            (($d & 0xff) << 8) | ($d >> 8));
+    } else {
+        printf("%s %u %s %u ", ntop($sk->__sk_common.skc_rcv_saddr),
+            $sk->__sk_common.skc_num, ntop($sk->__sk_common.skc_daddr),
+            (($d & 0xff) << 8) | ($d >> 8));
+    }
+    printf("%llu %llu %llu %llu %llu %llu %llu %llu %llu %u %u %u %u %u %u %u %u %llu %u %u\n",
+        $s->bytes_acked, $s->bytes_sent, $s->duration_us,
+        $s->mode_us[0], $s->mode_us[1], $s->mode_us[2], $s->mode_us[3],
+        $s->bw_max, $s->bw_median, $s->min_rtt_us, $s->qdelay_p90_us,
+        $s->retrans, $s->loss_backoffs, $s->lt_policer, $s->wd_resets,
+        $s->has_flow, $s->min_rtt_drains, $s->buf_bytes,
+        $s->buf_class, $s->random_lost);
+}
+interval:s:1 { @secs = @secs + 1; if ($1 && @secs >= $1) { exit(); } }
+END { clear(@secs); }
+'''
+
+
+def record(line):
+    v = line.split()
+    if len(v) != 24:
+        return None
+    saddr, sport, daddr, dport = v[:4]
+    n = [int(x) for x in v[4:]]
+    acked, sent, dur, m0, m1, m2, m3, bmax, bmed, mrtt, qd, rtx, boff, lt, wd, has, drains, buf, bcls, rnd = n
+    host = lambda a, p: f"[{a}]:{p}" if ":" in a else f"{a}:{p}"
+    return {
+        "local": host(saddr, sport), "remote": host(daddr, dport),
+        "bytes_acked": acked, "bytes_sent": sent,
+        "duration_ms": round(dur / 1e3, 3),
+        "mode_ms": {m: round(t / 1e3, 3) for m, t in zip(MODES, (m0, m1, m2, m3))},
+        "bw_max_mbit": round(bmax * 8 / 1e6, 3),
+        "bw_median_mbit": round(bmed * 8 / 1e6, 3),
+        "min_rtt_ms": round(mrtt / 1e3, 3), "qdelay_p90_ms": round(qd / 1e3, 3),
+        "retrans": rtx, "loss_backoffs": boff, "lt_policer": lt, "wd_resets": wd,
+        "min_rtt_drains": drains, "has_flow": has,
+        "buf_kbytes": round(buf / 1e3, 1),
+        "buf_class": BUF_CLASSES[bcls] if bcls < len(BUF_CLASSES) else bcls,
+        "random_lost": rnd,
+    }
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    p.add_argument("--duration", type=int, default=0, help="0 runs until interrupted")
+    p.add_argument("--output")
+    a = p.parse_args()
+
+    out = open(a.output, "a") if a.output else sys.stdout
+    bt = subprocess.Popen(["bpftrace", "-q", "-e", PROG, str(a.duration)],
+                          stdout=subprocess.PIPE, text=True)
+    try:
+        for line in bt.stdout:
+            r = record(line)
+            if r:
+                out.write(json.dumps(r) + "\n")
+                out.flush()
+    except KeyboardInterrupt:
+        bt.send_signal(signal.SIGINT)
+    bt.wait()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,218 @@
+#!/usr/bin/env python3
+"""Record Spline sockets with bpftrace and convert them to a Perfetto trace.
+
+  spline_trace.py record [--duration 60] [--interval-us 2000] RAW.csv
+  spline_trace.py convert RAW.csv TRACE.json
+
+record attaches to spline_main and to the decision hooks and writes one line
+per event until --duration runs out or it is interrupted:
+  n,ns,sk,saddr,sport,daddr,dport      first ACK of a socket
+  a,ns,sk,mode,cwnd,pacing,bw,mss,min_rtt,srtt,delivered
+                                       state on an ACK, at most every
+                                       --interval-us per socket and on every
+                                       mode change (pacing in bytes/s, bw in
+                                       Q24 packets/us, times in us)
+  l,ns,sk,lost                         packets newly marked lost
+  b,ns,sk,branch,target,curr,cwnd      next_cwnd picked another branch
+  e,ns,sk,epoch_round                  EPOCH_ROUND drawn at an epoch boundary
+  k,ns,sk,cwnd,backoff_cwnd            loss_backoff_cwnd cut the window
+
+convert writes the Chrome trace-event JSON that ui.perfetto.dev and
+chrome://tracing open. Every socket is one process named by its 4-tuple:
+  mode     thread with one slice per mode span
+  events   thread with instants for loss, epoch, next_cwnd branch, backoff
+  counters cwnd (segments), pacing, bw and goodput (Mbit/s), min_rtt and
+           queue_delay (srtt - min_rtt, ms)
+"""
+
+import argparse
+import collections
+import json
+import signal
+import subprocess
+import sys
+
+MODES = ("START", "PROBE_BW", "PROBE_RTT", "DRAIN")
+BRANCHES = ("LOSS", "UNFAIR", "MAX", "DRAIN", "UNRESP")
+BW_UNIT = 1 << 24
+TID_MODE, TID_EVENTS = 1, 2
+
+PROG = r'''
+kprobe:spline_main
+{
+    $sk = (struct sock *)arg0;
+    $tp = (struct tcp_sock *)arg0;
+    $scc = (struct scc *)(arg0 + offsetof(struct inet_connection_sock, icsk_ca_priv));
+    if (!@seen[arg0]) {
+        @seen[arg0] = 1;
+        @lost[arg0] = $tp->lost;
+        $d = $sk->__sk_common.skc_dport;
+        $dport = (($d & 0xff) << 8) | ($d >> 8);
+        if ($sk->__sk_common.skc_family == 10) {
+            printf("n,%llu,%llu,%s,%u,%s,%u\n", nsecs, arg0,
+                ntop($sk->__sk_common.skc_v6_rcv_saddr.in6_u.u6_addr8),
+                $sk->__sk_common.skc_num,
+                ntop($sk->__sk_common.skc_v6_daddr.in6_u.u6_addr8), $dport);
+        } else {
+            printf("n,%llu,%llu,%s,%u,%s,%u\n", nsecs, arg0,
+                ntop($sk->__sk_common.skc_rcv_saddr), $sk->__sk_common.skc_num,
+                ntop($sk->__sk_common.skc_daddr), $dport);
+        }
+    }
+    if ($tp->lost != @lost[arg0]) {
+        printf("l,%llu,%llu,%u\n", nsecs, arg0, $tp->lost - @lost[arg0]);
+        @lost[arg0] = $tp->lost;
+    }
+    if (nsecs - @last[arg0] >= (uint64)$1 * 1000 ||
+        $scc->current_mode + 1 != @mode[arg0]) {
+        @last[arg0] = nsecs;
+        @mode[arg0] = $scc->current_mode + 1;
+        printf("a,%llu,%llu,%u,%u,%llu,%u,%u,%u,%u,%u\n", nsecs, arg0,
+            $scc->current_mode, $tp->snd_cwnd, $sk->sk_pacing_rate, $scc->bw,
+            $tp->mss_cache, $scc->last_min_rtt, $tp->srtt_us >> 3,
+            $tp->delivered);
+    }
+}
+kprobe:spline_next_cwnd_hook
+{
+    $c = (struct spline_cwnd_ctx *)arg1;
+    if ($c->branch + 1 != @br[arg0]) {
+        @br[arg0] = $c->branch + 1;
+        printf("b,%llu,%llu,%u,%u,%u,%u\n", nsecs, arg0, $c->branch,
+            $c->target_cwnd, $c->curr_cwnd, $c->cwnd);
+    }
+}
+kprobe:spline_epoch_round_hook { printf("e,%llu,%llu,%u\n", nsecs, arg0, arg1); }
+kprobe:spline_backoff_hook { printf("k,%llu,%llu,%u,%u\n", nsecs, arg0, arg1, arg2); }
+kprobe:spline_release
+{
+    delete(@seen[arg0]); delete(@lost[arg0]); delete(@last[arg0]);
+    delete(@mode[arg0]); delete(@br[arg0]);
+}
+interval:s:1 { @secs = @secs + 1; if (@secs >= $2) { exit(); } }
+END { clear(@secs); clear(@seen); clear(@lost); clear(@last); clear(@mode); clear(@br); }
+'''
+
+
+def record(a):
+    with open(a.raw, "w") as out:
+        bt = subprocess.Popen(["bpftrace", "-q", "-e", PROG, str(a.interval_us),
+                               str(a.duration)], stdout=out)
+        try:
+            bt.wait()
+        except KeyboardInterrupt:
+            bt.send_signal(signal.SIGINT)
+            bt.wait()
+
+
+def name(i, sk, tup):
+    if tup is None:
+        return f"sk {i} ({sk})"
+    saddr, sport, daddr, dport = tup
+    return f"sk {i} {saddr}:{sport} -> {daddr}:{dport}"
+
+
+def convert(a):
+    socks = collections.OrderedDict()
+    tuples = {}
+    rows = []
+    with open(a.raw) as f:
+        for line in f:
+            v = line.rstrip("\n").split(",")
+            if len(v) < 3 or not v[1].isdigit():
+                continue
+            if v[0] == "n":
+                tuples[v[2]] = v[3:7]
+            rows.append(v)
+            socks.setdefault(v[2], len(socks) + 1)
+    if not rows:
+        sys.exit("no events")
+    # bpftrace flushes per CPU, so lines are only roughly in time order.
+    rows.sort(key=lambda v: int(v[1]))
+    t0 = min(int(v[1]) for v in rows)
+    us = lambda ns: (int(ns) - t0) / 1e3
+
+    ev = []
+    for sk, pid in socks.items():
+        ev.append({"ph": "M", "name": "process_name", "pid": pid,
+                   "args": {"name": name(pid, sk, tuples.get(sk))}})
+        ev.append({"ph": "M", "name": "process_sort_index", "pid": pid,
+                   "args": {"sort_index": pid}})
+        ev.append({"ph": "M", "name": "thread_name", "pid": pid, "tid": TID_MODE,
+                   "args": {"name": "mode"}})
+        ev.append({"ph": "M", "name": "thread_name", "pid": pid, "tid": TID_EVENTS,
+                   "args": {"name": "events"}})
+
+    span = {}       # sk -> (mode, start us)
+    prev = {}       # sk -> (us, delivered, mss)
+    last_ts = {}
+
+    def close(sk, ts):
+        m, start = span.pop(sk)
+        ev.append({"ph": "X", "name": MODES[m] if m < len(MODES) else str(m),
+                   "cat": "mode", "pid": socks[sk], "tid": TID_MODE,
+                   "ts": start, "dur": max(ts - start, 0)})
+
+    def counter(sk, ts, key, val):
+        ev.append({"ph": "C", "name": key, "pid": socks[sk], "ts": ts,
+                   "args": {key: round(val, 3)}})
+
+    def instant(sk, ts, key, args):
+        ev.append({"ph": "i", "s": "t", "name": key, "cat": "event",
+                   "pid": socks[sk], "tid": TID_EVENTS, "ts": ts, "args": args})
+
+    for v in rows:
+        kind, sk, ts = v[0], v[2], us(v[1])
+        last_ts[sk] = ts
+        if kind == "a":
+            mode, cwnd, pacing, bw, mss, min_rtt, srtt, delivered = map(int, v[3:11])
+            if sk in span and span[sk][0] != mode:
+                close(sk, ts)
+            if sk not in span:
+                span[sk] = (mode, ts)
+            counter(sk, ts, "cwnd", cwnd)
+            counter(sk, ts, "pacing", pacing * 8 / 1e6)
+            counter(sk, ts, "bw", bw * mss * 8 / BW_UNIT)
+            counter(sk, ts, "min_rtt", min_rtt / 1e3)
+            counter(sk, ts, "queue_delay", max(srtt - min_rtt, 0) / 1e3)
+            if sk in prev and ts > prev[sk][0]:
+                pts, pdel, _ = prev[sk]
+                counter(sk, ts, "goodput",
+                        ((delivered - pdel) % (1 << 32)) * mss * 8 / (ts - pts))
+            prev[sk] = (ts, delivered, mss)
+        elif kind == "l":
+            instant(sk, ts, "loss", {"lost": int(v[3])})
+        elif kind == "b":
+            br = int(v[3])
+            instant(sk, ts, "next_cwnd " + (BRANCHES[br] if br < len(BRANCHES) else v[3]),
+                    {"target_cwnd": int(v[4]), "curr_cwnd": int(v[5]), "cwnd": int(v[6])})
+        elif kind == "e":
+            instant(sk, ts, "epoch", {"epoch_round": int(v[3])})
+        elif kind == "k":
+            instant(sk, ts, "backoff", {"cwnd": int(v[3]), "backoff_cwnd": int(v[4])})
+
+    for sk in list(span):
+        close(sk, last_ts[sk])
+
+    with open(a.trace, "w") as f:
+        json.dump({"traceEvents": ev, "displayTimeUnit": "ms"}, f)
+    print(f"{len(socks)} sockets, {len(ev)} events -> {a.trace}", file=sys.stderr)
+
+
+def main():
+    p = argparse.ArgumentParser(description=__doc__,
+                                formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = p.add_subparsers(dest="cmd", required=True)
+    r = sub.add_parser("record")
+    r.add_argument("--duration", type=int, default=60)
+    r.add_argument("--interval-us", type=int, default=2000)
+    r.add_argument("raw")
+    c = sub.add_parser("convert")
+    c.add_argument("raw")
+    c.add_argument("trace")
+    a = p.parse_args()
+    record(a) if a.cmd == "record" else convert(a)
+
+
+if __name__ == "__main__":
+    main()